@@ -0,0 +1,187 @@
+/******************************************
+ *
+ * arcCascade.cpp
+ *
+ * Cascades of the filters' stages, read from a config file (see
+ * FilterCascade) rather than fixed by the filter type, and ordered, if
+ * the config says to, by what each stage costs per arc it prunes on a
+ * sample of sentences.  The engine itself is ArcFilter::cascadeFilter.
+ *
+ ******************************************/
+
+#include "arcFilter.h"
+#include "lineReader.h"
+
+#include <fstream>    // For the config and sample files
+#include <sstream>    // For splitting the config's lines
+#include <utility>    // For pair
+
+// The stage with this name, or -1:
+static int cascadeStage(const std::string &name) {
+  for (int s=0; s<NUMCASCADESTAGES; s++)
+	if (name == cascadeStageName(s)) return s;
+  return -1;
+}
+
+// Read a cascade's config file, or stop the program if it's bad:
+void readCascade(const char *filename, FilterCascade &cascade) {
+  std::ifstream in(filename);
+  if (!in) {
+	std::cerr << "Error! Cascade file " << filename << " can not be opened" << std::endl;
+	exit(-1);
+  }
+  cascade = FilterCascade();
+  bool haveStages = false;
+  std::string line;
+  for (int lineNum = 1; getline(in, line); lineNum++) {
+	line = line.substr(0, line.find('#'));
+	std::istringstream words(line);
+	std::string directive, arg;
+	if (!(words >> directive)) continue;
+	std::vector<std::string> args;
+	while (words >> arg) args.push_back(arg);
+
+	bool ok = true;
+	if (directive == "rules") {
+	  ok = args.empty();
+	  cascade.rules = true;
+	} else if (directive == "linear" || directive == "quad" || directive == "pair") {
+	  ok = (args.size() == 1);
+	  if (ok) {
+		if (directive == "linear") cascade.linearFile = args[0];
+		else if (directive == "quad") cascade.quadFile = args[0];
+		else cascade.pairFile = args[0];
+	  }
+	} else if (directive == "stages") {
+	  cascade.stages.clear();
+	  haveStages = true;
+	  for (int a=0; a<(int)(args.size()) && ok; a++) {
+		int stage = cascadeStage(args[a]);
+		ok = (stage >= 0);
+		for (int s=0; s<(int)(cascade.stages.size()) && ok; s++)
+		  ok = (cascade.stages[s] != stage);
+		if (ok) cascade.stages.push_back((CascadeStage)stage);
+	  }
+	} else if (directive == "order") {
+	  ok = (args.size() == 2 && args[0] == "cost");
+	  if (ok) cascade.sampleFile = args[1];
+	} else {
+	  ok = false;
+	}
+	if (!ok) {
+	  std::cerr << "Error! Bad line " << lineNum << " in cascade file " << filename << ": " << line << std::endl;
+	  exit(-1);
+	}
+  }
+
+  // Each stage needs its rules or weights:
+  if (!haveStages) {
+	std::cerr << "Error! Cascade file " << filename << " has no stages" << std::endl;
+	exit(-1);
+  }
+  for (int s=0; s<(int)(cascade.stages.size()); s++) {
+	const char *missing = NULL;
+	switch (cascade.stages[s]) {
+	case CASCADE_ROLES:
+	  if (!cascade.rules && cascade.linearFile.empty()) missing = "rules or linear weights";
+	  break;
+	case CASCADE_ROOTS:
+	  if (cascade.linearFile.empty()) missing = "linear weights";
+	  break;
+	case CASCADE_QUAD:
+	  if (cascade.quadFile.empty()) missing = "quad weights";
+	  break;
+	case CASCADE_PAIR:
+	  if (cascade.pairFile.empty()) missing = "pair weights";
+	  break;
+	default:
+	  break;
+	}
+	if (missing != NULL) {
+	  std::cerr << "Error! The " << cascadeStageName(cascade.stages[s]) << " stage in cascade file "
+				<< filename << " needs " << missing << std::endl;
+	  exit(-1);
+	}
+  }
+}
+
+// Load the rules and just the weights the cascade's stages need:
+ArcFilter::ArcFilter(const FilterCascade &config)
+  : filterType(CASCADE_FILTER), useRules(false), useLinear(false), cascade(config),
+	scoreStage(NUMCASCADESTAGES), noneBias(0), pairBias(0), numTags(0), rootTagId(-1) {
+  bool staged[NUMCASCADESTAGES] = { false };
+  for (int s=0; s<(int)(cascade.stages.size()); s++)
+	staged[cascade.stages[s]] = true;
+  // Only the roles and the roots come from the token-role filters:
+  useRules = cascade.rules && staged[CASCADE_ROLES];
+  useLinear = !cascade.linearFile.empty() && (staged[CASCADE_ROLES] || staged[CASCADE_ROOTS]);
+  // The arcs get the quad's scores, else the pair scores, else the
+  // linear filter's:
+  if (staged[CASCADE_PAIR]) scoreStage = CASCADE_PAIR;
+  if (staged[CASCADE_QUAD]) scoreStage = CASCADE_QUAD;
+
+  loadRules();
+  if (useLinear)
+	linWeights.load(cascade.linearFile.c_str(), LINEAR_MODEL);
+  linTemplates = linWeights.templates();
+  if (staged[CASCADE_QUAD])
+	loadQuad(cascade.quadFile.c_str());
+  if (staged[CASCADE_PAIR])
+	loadPair(cascade.pairFile.c_str());
+
+  if (!cascade.sampleFile.empty())
+	orderCascade(cascade.sampleFile.c_str());
+}
+
+// Order the stages greedily: next comes whichever costs the least per
+// arc it prunes, of the arcs that the stages already chosen keep.  A
+// stage that prunes none of them costs the time it takes, after any
+// that prune some:
+void ArcFilter::orderCascade(const char *sampleFile) {
+  std::ifstream in(sampleFile);
+  if (!in) {
+	std::cerr << "Error! Sample file " << sampleFile << " can not be opened" << std::endl;
+	exit(-1);
+  }
+  std::vector<Sentence> sample;
+  LineReader reader(in);
+  char *line;
+  int len;
+  while (reader.nextLine(line, len)) {
+	sample.push_back(Sentence());
+	readSentence(line, len, sample.back().words, sample.back().tags);
+  }
+  std::cerr << "Ordering the cascade on " << sample.size() << " sentences:" << std::endl;
+
+  std::vector<CascadeStage> left = cascade.stages, order;
+  HeadLists heads;
+  while (!left.empty()) {
+	int best = -1;
+	std::pair<bool,double> bestCost;
+	uint64_t bestArcs = 0, bestKept = 0;
+	for (int c=0; c<(int)(left.size()); c++) {
+	  CascadeStage stage = left[c];
+	  cascade.stages = order;
+	  cascade.stages.push_back(stage);
+	  FilterStats stats;
+	  for (int i=0; i<(int)(sample.size()); i++)
+		filterSentence(sample[i], heads, &stats);
+	  uint64_t pruned = stats.cascadeArcs[stage] - stats.cascadeKept[stage];
+	  std::pair<bool,double> cost(pruned == 0, (double)stats.cascadeNs[stage] / (pruned > 0 ? pruned : 1));
+	  if (best < 0 || cost < bestCost) {
+		best = c;
+		bestCost = cost;
+		bestArcs = stats.cascadeArcs[stage];
+		bestKept = stats.cascadeKept[stage];
+	  }
+	}
+	std::cerr << "  " << cascadeStageName(left[best]) << ": kept " << bestKept << " of " << bestArcs << " arcs, ";
+	if (bestCost.first)
+	  std::cerr << "pruning none" << std::endl;
+	else
+	  std::cerr << bestCost.second << "ns per arc pruned" << std::endl;
+	order.push_back(left[best]);
+	left.erase(left.begin() + best);
+  }
+  cascade.stages = order;
+}
@@ -0,0 +1,293 @@
+/******************************************
+ *
+ * arcEval.cpp
+ *
+ * Sweeping the filters' margins against gold heads: each sentence's
+ * scores are worked out once, then the decisions are made from them at
+ * every setting of the grid, counting the arcs and gold arcs kept.
+ *
+ ******************************************/
+
+#include "arcFilter.h"
+#include "scoreKernel.h"
+
+#include <limits>     // For infinity
+#include <algorithm>  // For max
+
+// Lower than any score, for a test that can't fire:
+static const float NOSCORE = -std::numeric_limits<float>::infinity();
+
+// Is head the gold head of mod?
+static inline bool isGold(const std::vector<int> &goldHeads, int head, int mod) {
+  return mod < (int)(goldHeads.size()) && goldHeads[mod] == head;
+}
+
+// The token-role filter decisions for one token:
+struct TokenRoles {
+  bool head, root, Lx, L1, L5, Rx, R1, R5;
+};
+
+// Filter one sentence at every setting of the grid:
+void ArcFilter::sweepSentence(const Sentence &sent, const std::vector<int> &goldHeads,
+							  const MarginGrid &grid, SweepCounts &counts) const {
+  if (!fits(sent)) {
+	counts.unfitSentences++;
+	return;
+  }
+  int sentSize = sent.tags.size();
+  if (sentSize == 0)
+	return;
+  counts.sentences++;
+  counts.arcs += (uint64_t)(sentSize - 1) * (sentSize - 1);
+  for (int mod = 1; mod < sentSize && mod < (int)(goldHeads.size()); mod++)
+	if (goldHeads[mod] >= 0 && goldHeads[mod] < sentSize && goldHeads[mod] != mod)
+	  counts.goldArcs++;
+
+  if (filterType == ULTRA_FILTER)
+	sweepUltraFilter(sent, goldHeads, grid, counts);
+  else if (filterType == CASCADE_FILTER)
+	sweepCascade(sent, goldHeads, grid, counts);
+  else
+	sweepRoleFilter(sent, goldHeads, grid, counts);
+}
+
+// A cascade has no margins to sweep, so every setting of the grid gets
+// the same decisions, its own:
+void ArcFilter::sweepCascade(const Sentence &sent, const std::vector<int> &goldHeads,
+							 const MarginGrid &grid, SweepCounts &counts) const {
+  HeadLists heads;
+  filterSentence(sent, heads);
+  uint64_t goldKept = 0, arcsKept = 0;
+  for (int mod = 1; mod < (int)(heads.size()); mod++) {
+	arcsKept += heads[mod].size();
+	for (int i=0; i<(int)(heads[mod].size()); i++)
+	  if (isGold(goldHeads, heads[mod][i], mod)) goldKept++;
+  }
+  for (int g=0; g<(int)(counts.arcsKept.size()); g++) {
+	counts.goldKept[g] += goldKept;
+	counts.arcsKept[g] += arcsKept;
+  }
+}
+
+// The rule, linear and quad filters: the token-role filters are made
+// afresh for each role margin, as getRoleFilters makes them, and the
+// arcs that get through are scored by the quad (once each) and kept
+// or not at each score margin (the quad keeps arcs rather than pruning
+// them, so its margin comes off its threshold):
+void ArcFilter::sweepRoleFilter(const Sentence &sent, const std::vector<int> &goldHeads,
+								const MarginGrid &grid, SweepCounts &counts) const {
+  const StrVec &words = sent.words;
+  const StrVec &tags = sent.tags;
+  int sentSize = tags.size();
+  int numScore = grid.scoreMargins.size();
+
+  // What doesn't depend on the margins: the rules, the linear scores,
+  // and the pair rules:
+  std::vector<char> tabooHead(sentSize), noLeft(sentSize), noRight(sentSize);
+  std::vector<float> scores(sentSize * 8, 0);
+  FeatureIds linFeats;
+  for (int i=1; i<sentSize; i++) {
+	tabooHead[i] = tabooHeads.find(tags[i]) != tabooHeads.end();
+	noLeft[i] = noLeftHead.find(tags[i]) != noLeftHead.end();
+	noRight[i] = noRightHead.find(tags[i]) != noRightHead.end();
+	if (filterType != RULE_FILTER) {
+	  linFeats.clear();
+	  buildLinearFeatureIds(i, words, tags, sentSize, linFeats, &linTemplates);
+	  sumLinearScores(linWeights, linFeats, &scores[i * 8]);
+	}
+  }
+  std::vector<int> tagIds(sentSize);
+  internTags(tags, &tagIds[0]);
+  std::vector<char> taboo(sentSize * sentSize);
+  for (int mod = 1; mod < sentSize; mod++)
+	for (int head = 0; head < sentSize; head++)
+	  taboo[mod * sentSize + head] = isTabooPair(head < mod, tagIds[head], tagIds[mod], tags[head], tags[mod]);
+
+  // The quad scores, worked out the first time each arc gets through:
+  QuadFragments frags;
+  std::vector<float> quadScores;
+  std::vector<char> scored;
+  if (filterType == QUAD_FILTER) {
+	buildQuadFragments(words, tags, sentSize, frags);
+	quadScores.resize(sentSize * sentSize);
+	scored.resize(sentSize * sentSize);
+  }
+
+  std::vector<TokenRoles> roles(sentSize);
+  std::vector<int> rootBefore(sentSize), rootAfter(sentSize);
+  for (int r=0; r<(int)(grid.roleMargins.size()); r++) {
+	float threshold = LINEAR_THRESHOLD + grid.roleMargins[r];
+	bool anyRoot = false;
+	for (int i=1; i<sentSize; i++) {
+	  TokenRoles &t = roles[i];
+	  t.head = t.root = t.Lx = t.L1 = t.L5 = t.Rx = t.R1 = t.R5 = false;
+	  if (filterType == RULE_FILTER) {
+		t.head = tabooHead[i];
+		t.Lx = noLeft[i];
+		t.Rx = noRight[i];
+		continue;
+	  }
+	  unsigned int preds = 0;
+	  for (int k=0; k<8; k++)
+		if (scores[i * 8 + k] > threshold) preds |= 1 << k;
+	  t.head = tabooHead[i] || firesFilter(preds, HEAD_FILTER);
+	  t.root = firesFilter(preds, ROOT_FILTER);
+	  if (noLeft[i]) {
+		t.Lx = true;
+	  } else {
+		t.L1 = firesFilter(preds, L1_FILTER);
+		t.L5 = firesFilter(preds, L5_FILTER);
+	  }
+	  if (noRight[i]) {
+		t.Rx = true;
+	  } else {
+		t.R1 = firesFilter(preds, R1_FILTER);
+		t.R5 = firesFilter(preds, R5_FILTER);
+		if (!noLeft[i]) {
+		  t.Rx = firesFilter(preds, RX_FILTER);
+		  t.Lx = firesFilter(preds, LX_FILTER);
+		}
+	  }
+	  anyRoot = anyRoot || t.root;
+	}
+	for (int i = 1, last = 0; i < sentSize; i++) {
+	  rootBefore[i] = last;
+	  if (roles[i].root) last = i;
+	}
+	for (int i = sentSize-1, next = sentSize-1; i > 0; i--) {
+	  rootAfter[i] = next;
+	  if (roles[i].root) next = i;
+	}
+
+	for (int mod = 1; mod < sentSize; mod++) {
+	  const TokenRoles &t = roles[mod];
+	  int lo = rootBefore[mod], hi = rootAfter[mod];
+	  if (t.Lx) lo = std::max(lo, mod+1);
+	  if (t.Rx) hi = std::min(hi, mod-1);
+	  if (t.L1) { lo = std::max(lo, mod-1); hi = std::min(hi, mod-1); }
+	  if (t.R1) { lo = std::max(lo, mod+1); hi = std::min(hi, mod+1); }
+	  if (t.L5) { lo = std::max(lo, mod-5); hi = std::min(hi, mod-1); }
+	  if (t.R5) { lo = std::max(lo, mod+1); hi = std::min(hi, mod+5); }
+	  for (int head = lo; head <= hi; head++) {
+		if (head == mod || (head != 0 && roles[head].head) || taboo[mod * sentSize + head])
+		  continue;
+		if (head == 0 && anyRoot && !t.root)
+		  continue;
+		bool gold = isGold(goldHeads, head, mod);
+		uint64_t *arcsKept = &counts.arcsKept[r * numScore];
+		uint64_t *goldKept = &counts.goldKept[r * numScore];
+		if (filterType != QUAD_FILTER) {
+		  for (int s=0; s<numScore; s++) {
+			arcsKept[s]++;
+			if (gold) goldKept[s]++;
+		  }
+		  continue;
+		}
+		int arc = mod * sentSize + head;
+		if (!scored[arc]) {
+		  quadScores[arc] = quadScore(head, mod, sent, &tagIds[0], frags);
+		  scored[arc] = 1;
+		}
+		for (int s=0; s<numScore; s++) {
+		  if (quadScores[arc] > QUAD_THRESHOLD - grid.scoreMargins[s]) {
+			arcsKept[s]++;
+			if (gold) goldKept[s]++;
+		  }
+		}
+	  }
+	}
+  }
+}
+
+// Count one arc of the ultra sweep at every setting of the grid, given
+// the highest of the token-role (and root) scores that could prune it:
+static inline void countUltraArc(float noneScore, float pairScore, float roleScore, bool gold,
+								 const MarginGrid &grid, SweepCounts &counts) {
+  int numScore = grid.scoreMargins.size();
+  for (int r=0; r<(int)(grid.roleMargins.size()); r++) {
+	if (roleScore > noneScore + grid.roleMargins[r])
+	  continue;
+	for (int s=0; s<numScore; s++) {
+	  if (pairScore > noneScore + grid.scoreMargins[s])
+		continue;
+	  counts.arcsKept[r * numScore + s]++;
+	  if (gold) counts.goldKept[r * numScore + s]++;
+	}
+  }
+}
+
+// The ultra filter: an arc is pruned when any of its token-role tests
+// beats the none score, i.e. when the highest of those scores does, so
+// each arc comes down to three scores, compared at every setting:
+void ArcFilter::sweepUltraFilter(const Sentence &sent, const std::vector<int> &goldHeads,
+								 const MarginGrid &grid, SweepCounts &counts) const {
+  const StrVec &words = sent.words;
+  const StrVec &tags = sent.tags;
+  int sentSize = tags.size();
+
+  // The token-role scores, and the root scores of the possible roots:
+  std::vector<float> scores(sentSize * 8, 0);
+  std::vector<float> rootScore(sentSize, NOSCORE);
+  FeatureIds linFeats;
+  for (int i=1; i<sentSize; i++) {
+	linFeats.clear();
+	buildLinearFeatureIds(i, words, tags, sentSize, linFeats, &linTemplates);
+	sumLinearScores(linWeights, linFeats, &scores[i * 8]);
+	if (tags[i] == "VBD" || tags[i] == "VBZ" || tags[i] == "VBP" || tags[i] == "MD")
+	  rootScore[i] = scores[i * 8 + ROOT_FILTER];
+  }
+  std::vector<int> tagIds(sentSize);
+  internTags(tags, &tagIds[0]);
+  tagIds[0] = rootTagId;
+  // The best root score before and after each token:
+  std::vector<float> rootBefore(sentSize, NOSCORE), rootAfter(sentSize, NOSCORE);
+  for (int i=2; i<sentSize; i++)
+	rootBefore[i] = std::max(rootBefore[i-1], rootScore[i-1]);
+  for (int i=sentSize-2; i>0; i--)
+	rootAfter[i] = std::max(rootAfter[i+1], rootScore[i+1]);
+
+  for (int mod = 1; mod < sentSize; mod++) {
+	int modId = tagIds[mod];
+	const float *modS = &scores[mod * 8];
+	// The root as head: pruned by any other root
+	{
+	  static const std::string rootTag = "ROOT";
+	  const float *finder = pairRow(true, rootTagId, modId, rootTag, tags[mod]);
+	  float noneScore = noneBias + finder[0] * mod; float pairScore = pairBias + finder[1] * mod;
+	  float roleScore = std::max(std::max(modS[LX_FILTER], modS[R1_FILTER]), modS[R5_FILTER]);
+	  if (mod != 1) roleScore = std::max(roleScore, modS[L1_FILTER]);
+	  if (mod > 5) roleScore = std::max(roleScore, modS[L5_FILTER]);
+	  roleScore = std::max(roleScore, std::max(rootBefore[mod], rootAfter[mod]));
+	  countUltraArc(noneScore, pairScore, roleScore, isGold(goldHeads, 0, mod), grid, counts);
+	}
+	// Heads before the mod, going out from it to keep track of the
+	// best root between them:
+	float between = NOSCORE;
+	for (int head = mod-1; head > 0; head--) {
+	  if (head < mod-1) between = std::max(between, rootScore[head+1]);
+	  const float *finder = pairRow(true, tagIds[head], modId, tags[head], tags[mod]);
+	  int distance = mod - head;
+	  float noneScore = noneBias + finder[0] * distance; float pairScore = pairBias + finder[1] * distance;
+	  float roleScore = std::max(std::max(scores[head * 8 + HEAD_FILTER], modS[LX_FILTER]),
+								 std::max(modS[R1_FILTER], modS[R5_FILTER]));
+	  if (head != mod-1) roleScore = std::max(roleScore, modS[L1_FILTER]);
+	  if (distance > 5) roleScore = std::max(roleScore, modS[L5_FILTER]);
+	  roleScore = std::max(roleScore, between);
+	  countUltraArc(noneScore, pairScore, roleScore, isGold(goldHeads, head, mod), grid, counts);
+	}
+	// And after it:
+	between = NOSCORE;
+	for (int head = mod+1; head < sentSize; head++) {
+	  if (head > mod+1) between = std::max(between, rootScore[head-1]);
+	  const float *finder = pairRow(false, tagIds[head], modId, tags[head], tags[mod]);
+	  int distance = head - mod;
+	  float noneScore = noneBias + finder[0] * distance; float pairScore = pairBias + finder[1] * distance;
+	  float roleScore = std::max(std::max(scores[head * 8 + HEAD_FILTER], modS[RX_FILTER]),
+								 std::max(modS[L1_FILTER], modS[L5_FILTER]));
+	  if (head != mod+1) roleScore = std::max(roleScore, modS[R1_FILTER]);
+	  if (distance > 5) roleScore = std::max(roleScore, modS[R5_FILTER]);
+	  roleScore = std::max(roleScore, between);
+	  countUltraArc(noneScore, pairScore, roleScore, isGold(goldHeads, head, mod), grid, counts);
+	}
+  }
+}
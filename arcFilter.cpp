@@ -0,0 +1,1071 @@
+/******************************************
+ *
+ * arcFilter.cpp
+ *
+ * The filter engines formerly inside each of the ruleFilter,
+ * linearFilter, quadFilter and ultraFilter programs.
+ *
+ ******************************************/
+
+#include "arcFilter.h"
+#include "scoreKernel.h"
+
+#include <math.h>     // For floor and log
+#include <algorithm>  // For min and max
+#include <fstream>    // For checking the weight files on reload
+
+// Per-sentence scratch space for up to N tokens: on the stack for the
+// small size classes, and on the heap for the general one (N == 0):
+template <class T, int N> class ScratchArray {
+ public:
+  explicit ScratchArray(int) {}
+  T &operator[](int i) { return items[i]; }
+  const T &operator[](int i) const { return items[i]; }
+ private:
+  T items[N];
+};
+
+template <class T> class ScratchArray<T,0> {
+ public:
+  explicit ScratchArray(int size) : items(new T[size > 0 ? size : 1]) {}
+  ~ScratchArray() { delete [] items; }
+  T &operator[](int i) { return items[i]; }
+  const T &operator[](int i) const { return items[i]; }
+ private:
+  ScratchArray(const ScratchArray &);
+  ScratchArray &operator=(const ScratchArray &);
+  T *items;
+};
+
+// Load the rule lists plus the weights needed by this filter type:
+ArcFilter::ArcFilter(FilterType type, const char *weightsA, const char *weightsB)
+  : filterType(type), useRules(true), useLinear(type != RULE_FILTER),
+	weightsFileA(weightsA != NULL ? weightsA : ""), weightsFileB(weightsB != NULL ? weightsB : ""),
+	scoreStage(NUMCASCADESTAGES), noneBias(0), pairBias(0), numTags(0), rootTagId(-1) {
+  ////////////////////////////////////////////////
+  // First, load the simple rule lists:
+  ////////////////////////////////////////////////
+  loadRules();
+
+  ////////////////////////////////////////////////
+  // Then, load the weight vectors:
+  ////////////////////////////////////////////////
+  if (useLinear && weightsA != NULL)
+	linWeights.load(weightsA, LINEAR_MODEL);
+  linTemplates = linWeights.templates();
+
+  if (type == QUAD_FILTER)
+	loadQuad(weightsB);
+  if (type == ULTRA_FILTER)
+	loadPair(weightsB);
+}
+
+// Load the rule lists and the tag set:
+void ArcFilter::loadRules() {
+  initializeTaboos(tabooHeads, noLeftHead, noRightHead, tabooPairs);
+  initializeTagSet(tagSet);
+  numTags = tagSet.size();
+  rootTagId = tagSet["ROOT"];
+  buildTabooMatrix();
+}
+
+// Load the quad weights (none if weightsFile is NULL), and the tables
+// made from them:
+void ArcFilter::loadQuad(const char *weightsFile) {
+  if (weightsFile != NULL)
+	quadWeights.load(weightsFile, QUAD_MODEL);
+  quadTemplates = quadWeights.templates();
+  buildQuadTagMatrix();
+  // Also, to save time, precompute log values for direct addressing, up
+  // to the longest distance (or count) in a sentence:
+  logPrecomputes.push_back(0);
+  for (int i=1; i<MAXSENTSIZE; i++) {
+	// Take it to the same number of sigdigs as you used in training:
+	float roundedFloat = floor(log(i+1) * 1000 + .5) / 1000;
+	logPrecomputes.push_back(roundedFloat);
+  }
+}
+
+// Load the pair weights (none if weightsFile is NULL), and the tables
+// made from them:
+void ArcFilter::loadPair(const char *weightsFile) {
+  if (weightsFile != NULL)
+	pairWeights.load(weightsFile, PAIR_MODEL);
+  // Get the bias of the pair and none filters:
+  const float *finder = pairWeights.find(featureId("bias"));
+  if (finder == NULL) {
+	std::cerr << "Error: no bias feature for the pair/none filters." << std::endl;
+	exit(-1);
+  }
+  noneBias = finder[0];
+  pairBias = finder[1];
+  // And take the tag pairs out of the hash table:
+  buildPairMatrix();
+}
+
+// Does it score the arcs it keeps?
+bool ArcFilter::hasScores() const {
+  if (filterType == CASCADE_FILTER)
+	return scoreStage != NUMCASCADESTAGES || useLinear;
+  return filterType != RULE_FILTER;
+}
+
+// Load this filter again from the same weight files.  Loading stops the
+// program on a bad file, as it always has, but a file that's missing or
+// unreadable just now (say, halfway through being replaced) shouldn't
+// bring down a server that's still working, so check for that first:
+ArcFilter *ArcFilter::reload() const {
+  std::vector<std::string> files;
+  if (filterType == CASCADE_FILTER) {
+	files.push_back(cascade.linearFile);
+	files.push_back(cascade.quadFile);
+	files.push_back(cascade.pairFile);
+	files.push_back(cascade.sampleFile);
+  } else {
+	files.push_back(weightsFileA);
+	files.push_back(weightsFileB);
+  }
+  for (int f=0; f<(int)(files.size()); f++) {
+	if (files[f].empty() || files[f] == "0") continue;
+	std::ifstream in(files[f].c_str());
+	if (!in) {
+	  std::cerr << "Error! File " << files[f] << " can not be opened; not reloading" << std::endl;
+	  return NULL;
+	}
+  }
+  ArcFilter *fresh;
+  if (filterType == CASCADE_FILTER)
+	fresh = new ArcFilter(cascade);
+  else
+	fresh = new ArcFilter(filterType, weightsFileA.empty() ? NULL : weightsFileA.c_str(),
+						  weightsFileB.empty() ? NULL : weightsFileB.c_str());
+  fresh->setHeadLimits(headLimits);
+  return fresh;
+}
+
+// Free the weights, and the tables built from them:
+void ArcFilter::releaseWeights() {
+  linWeights.release();
+  quadWeights.release();
+  pairWeights.release();
+  std::vector<float>().swap(quadTagMatrix);
+  std::vector<float>().swap(pairMatrix);
+  std::vector<float>().swap(logPrecomputes);
+}
+
+// Compile the pair weights into pairMatrix, over the tag set.  Missing
+// pairs get zero weights, which score just as a failed lookup would:
+void ArcFilter::buildPairMatrix() {
+  pairMatrix.assign(2 * numTags * numTags * 2, 0);
+  for (TagIndex::const_iterator h = tagSet.begin(); h != tagSet.end(); ++h) {
+	for (TagIndex::const_iterator m = tagSet.begin(); m != tagSet.end(); ++m) {
+	  const float *finder = findPairRow(true, h->first, m->first);
+	  float *row = &pairMatrix[((0 * numTags + h->second) * numTags + m->second) * 2];
+	  row[0] = finder[0]; row[1] = finder[1];
+	  finder = findPairRow(false, h->first, m->first);
+	  row = &pairMatrix[((1 * numTags + h->second) * numTags + m->second) * 2];
+	  row[0] = finder[0]; row[1] = finder[1];
+	}
+  }
+}
+
+// Compile the taboo pairs into tabooMatrix, over the tag set:
+void ArcFilter::buildTabooMatrix() {
+  tabooMatrix.assign(2 * numTags * numTags, false);
+  for (TagIndex::const_iterator h = tagSet.begin(); h != tagSet.end(); ++h) {
+	for (TagIndex::const_iterator m = tagSet.begin(); m != tagSet.end(); ++m) {
+	  tabooMatrix[(0 * numTags + h->second) * numTags + m->second] =
+		tabooPairs.find("h" + h->first + "<m" + m->first) != tabooPairs.end();
+	  tabooMatrix[(1 * numTags + h->second) * numTags + m->second] =
+		tabooPairs.find("m" + m->first + "<h" + h->first) != tabooPairs.end();
+	}
+  }
+}
+
+// One quad weight, or zero if it has none:
+static inline float quadWeight(const WeightTable &quadWeights, FeatureId id) {
+  const float *finder = quadWeights.find(id);
+  return finder != NULL ? *finder : 0;
+}
+
+// Compile the quad weights of the head and mod tags and direction alone
+// into quadTagMatrix and the scalars beside it.  Missing features get
+// zero weights, which add nothing, just as a failed lookup would:
+void ArcFilter::buildQuadTagMatrix() {
+  static const char *direction[2] = { ">", "<" };  // Head first, mod first
+  for (int dir=0; dir<2; dir++) {
+	quadDirWeights[dir] = quadWeight(quadWeights, featureId(direction[dir]));
+	quadDistWeights[dir] = quadWeight(quadWeights, featureId(std::string("D") + direction[dir]));
+  }
+  quadBias = quadWeight(quadWeights, featureId("bias"));
+  quadTagMatrix.assign(numTags * numTags * 2 * 2, 0);
+  for (TagIndex::const_iterator h = tagSet.begin(); h != tagSet.end(); ++h) {
+	for (TagIndex::const_iterator m = tagSet.begin(); m != tagSet.end(); ++m) {
+	  FeatureId tagPair = extendId(extendId(EMPTY_ID, h->first), m->first);
+	  for (int dir=0; dir<2; dir++) {
+		float *row = &quadTagMatrix[((h->second * numTags + m->second) * 2 + dir) * 2];
+		row[0] = quadWeight(quadWeights, extendId(tagPair, direction[dir]));
+		row[1] = quadWeight(quadWeights, tagPair);
+	  }
+	}
+  }
+}
+
+// The quad filter's score for one arc.  The features are built up as
+// IDs from the sentence's fragments, and the tag-only weights come from
+// quadTagMatrix (or, for tags outside the tag set, from quadWeights).
+// Everything is added in just the order getQuadraticFilterPredictions
+// would add it, so that the score comes out to the very same float:
+float ArcFilter::quadScore(int head, int mod, const Sentence &sent, const int *tagIds,
+						   const QuadFragments &frags) const {
+  const StrVec &words = sent.words;
+  const StrVec &tags = sent.tags;
+  int dir = (head < mod) ? 0 : 1;
+  char direction = (head < mod) ? '>' : '<';
+  int distance = (head < mod) ? mod - head : head - mod;
+  float keyWeight, tagPairWeight;
+  if (tagIds[head] >= 0 && tagIds[mod] >= 0) {
+	const float *row = &quadTagMatrix[((tagIds[head] * numTags + tagIds[mod]) * 2 + dir) * 2];
+	keyWeight = row[0]; tagPairWeight = row[1];
+  } else {
+	FeatureId tagPair = extendId(frags.tagIds[head], tags[mod]);
+	keyWeight = quadWeight(quadWeights, extendId(tagPair, direction));
+	tagPairWeight = quadWeight(quadWeights, tagPair);
+  }
+  // The key triple, th + tm + direction, as a suffix:
+  const std::string &th = tags[head];
+  const std::string &tm = tags[mod];
+  FeatureId keyTriple = extendId(extendId(frags.tagIds[head], tm), direction);
+
+  // (Templates without any weights would only add zeros, so they're
+  // skipped.)
+  const TemplateMask &on = quadTemplates;
+  float score = 0;
+  score += quadDirWeights[dir];
+  if (on.has(HEADTAG_MODWORD_Q))
+	score += quadWeight(quadWeights, extendId(extendId(frags.headTagTilde[head], words[mod]), direction));
+  if (on.has(HEADWORD_MODTAG_Q))
+	score += quadWeight(quadWeights, extendId(extendId(frags.headWordStar[head], tm), direction));
+  score += keyWeight;
+  if (on.has(MOD_LEFT_Q))
+	score += quadWeight(quadWeights, extendId(extendId(extendId(frags.modLeft[mod], th), tm), direction));
+  if (on.has(MOD_RIGHT_Q))
+	score += quadWeight(quadWeights, extendId(extendId(extendId(frags.modRight[mod], th), tm), direction));
+  if (head != 0) {
+	if (on.has(HEAD_LEFT_Q))
+	  score += quadWeight(quadWeights, extendId(extendId(extendId(frags.headLeft[head], th), tm), direction));
+	if (on.has(HEAD_RIGHT_Q))
+	  score += quadWeight(quadWeights, extendId(extendId(extendId(frags.headRight[head], th), tm), direction));
+  }
+  score += quadBias;
+  score += quadDistWeights[dir] * logPrecomputes[distance];
+  score += tagPairWeight * logPrecomputes[distance];
+  if (head != 0) {
+	// The tags, then the words, between them:
+	BetweenCount counts[2*WIDTH];
+	int numCounts;
+	if (on.has(BETWEEN_TAGS_Q)) {
+	  numCounts = getBetweenCounts(head, mod, tags, frags.tagIds, counts);
+	  for (int k=0; k<numCounts; k++)
+		score += quadWeight(quadWeights, extendId(keyTriple, tags[counts[k].token])) * logPrecomputes[counts[k].count];
+	}
+	if (on.has(BETWEEN_WORDS_Q)) {
+	  FeatureId keyWord = extendId(keyTriple, '!');
+	  numCounts = getBetweenCounts(head, mod, words, frags.wordIds, counts);
+	  for (int k=0; k<numCounts; k++)
+		score += quadWeight(quadWeights, extendId(keyWord, words[counts[k].token])) * logPrecomputes[counts[k].count];
+	}
+  }
+  return score;
+}
+
+// The quad filter's second pass: score, in one go, all the arcs that
+// got through the rules and the linear filters, and drop the ones the
+// quad doesn't keep:
+void ArcFilter::quadFilter(const Sentence &sent, const int *tagIds, HeadLists &heads, FilterStats *stats,
+						   HeadScoreLists *scores) const {
+  int sentSize = sent.tags.size();
+  QuadFragments frags;
+  buildQuadFragments(sent.words, sent.tags, sentSize, frags);
+  for (int mod = 1; mod < sentSize; mod++) {
+	HeadList &headList = heads[mod];
+	int kept = 0;
+	for (int i=0; i<(int)(headList.size()); i++) {
+	  float score = quadScore(headList[i], mod, sent, tagIds, frags);
+	  if (score > QUAD_THRESHOLD) {
+		headList[kept++] = headList[i];
+		if (scores != NULL) (*scores)[mod].push_back(score);
+	  }
+	}
+	if (stats != NULL) stats->pruned[PRUNE_QUAD_SCORE] += headList.size() - kept;
+	headList.resize(kept);
+
+	if (scores != NULL && headLimits.active()) {
+	  HeadScores &headScores = (*scores)[mod];
+	  if (headList.empty()) {
+		// Give it back its best head:
+		int bestHead = -1;
+		float bestScore = 0;
+		for (int head = 0; head < sentSize; head++) {
+		  if (head == mod) continue;
+		  float score = quadScore(head, mod, sent, tagIds, frags);
+		  if (bestHead < 0 || score > bestScore) { bestHead = head; bestScore = score; }
+		}
+		headList.push_back(bestHead);
+		headScores.push_back(bestScore);
+		if (stats != NULL) stats->arcsRestored++;
+	  }
+	  limitHeads(headList, headScores, stats);
+	}
+  }
+}
+
+// Look up each tag's ID in the tag set (-1 if it's not there):
+void ArcFilter::internTags(const StrVec &tags, int *tagIds) const {
+  for (int i=0; i<(int)(tags.size()); i++) {
+	TagIndex::const_iterator tagId = tagSet.find(tags[i]);
+	tagIds[i] = (tagId != tagSet.end()) ? tagId->second : -1;
+  }
+}
+
+// The (none, pair) weights of a head and mod tag, from the hash table,
+// e.g. "hDT<mNN" when the head comes first and "mNN<hVBD" when not:
+const float *ArcFilter::findPairRow(bool headFirst, const std::string &headTag, const std::string &modTag) const {
+  static const float noWeights[2] = { 0, 0 };
+  FeatureId id = EMPTY_ID;
+  if (headFirst) {
+	id = extendId(extendId(extendId(id, 'h'), headTag), "<m");
+	id = extendId(id, modTag);
+  } else {
+	id = extendId(extendId(extendId(id, 'm'), modTag), "<h");
+	id = extendId(id, headTag);
+  }
+  const float *finder = pairWeights.find(id);
+  return finder != NULL ? finder : noWeights;
+}
+
+// Can this sentence be filtered at all?
+bool ArcFilter::fits(const Sentence &sent) const {
+  // The ultra filter keeps its scores in vectors, not bitsets:
+  return filterType == ULTRA_FILTER || (int)(sent.tags.size()) <= MAXSENTSIZE;
+}
+
+// Find the possible heads of every mod in one sentence:
+bool ArcFilter::filterSentence(const Sentence &sent, HeadLists &heads, FilterStats *stats,
+							   HeadScoreLists *scores) const {
+  heads.clear();
+  if (scores != NULL)
+	scores->clear();
+  if (!fits(sent)) {
+	if (stats != NULL) stats->unfitSentences++;
+	return false;
+  }
+  int sentSize = sent.tags.size();
+  heads.resize(sentSize);
+  // The head limits need the heads' scores, even if the caller doesn't:
+  HeadScoreLists limitScores;
+  if (scores == NULL && headLimits.active())
+	scores = &limitScores;
+  if (scores != NULL)
+	scores->resize(sentSize);
+  uint64_t startNs = (stats != NULL) ? statsClock() : 0;
+  // Pick the engine for the sentence's size class:
+  if (filterType == ULTRA_FILTER) {
+	if (sentSize <= SMALLSENTSIZE)
+	  ultraFilter<SMALLSENTSIZE>(sent, heads, stats, scores);
+	else if (sentSize <= MEDIUMSENTSIZE)
+	  ultraFilter<MEDIUMSENTSIZE>(sent, heads, stats, scores);
+	else
+	  ultraFilter<0>(sent, heads, stats, scores);
+  } else if (filterType == CASCADE_FILTER) {
+	if (sentSize <= SMALLSENTSIZE)
+	  cascadeFilter<SMALLSENTSIZE>(sent, heads, stats, scores);
+	else if (sentSize <= MEDIUMSENTSIZE)
+	  cascadeFilter<MEDIUMSENTSIZE>(sent, heads, stats, scores);
+	else
+	  cascadeFilter<MAXSENTSIZE>(sent, heads, stats, scores);
+  } else {
+	if (sentSize <= SMALLSENTSIZE)
+	  roleFilter<SMALLSENTSIZE>(sent, heads, stats, scores);
+	else if (sentSize <= MEDIUMSENTSIZE)
+	  roleFilter<MEDIUMSENTSIZE>(sent, heads, stats, scores);
+	else
+	  roleFilter<MAXSENTSIZE>(sent, heads, stats, scores);
+  }
+  if (stats != NULL) {
+	if (sentSize > 0) {
+	  stats->addLatency(statsClock() - startNs);
+	  stats->sentences++;
+	  stats->tokens += sentSize - 1;
+	  stats->arcsConsidered += (uint64_t)(sentSize - 1) * (sentSize - 1);
+	  for (int mod = 1; mod < sentSize; mod++)
+		stats->arcsKept += heads[mod].size();
+	}
+  }
+  return true;
+}
+
+// Limit the heads each mod keeps from now on:
+void ArcFilter::setHeadLimits(const HeadLimits &limits) {
+  if (limits.active() && !hasScores()) {
+	std::cerr << "Error! This filter has no scores to limit the heads by" << std::endl;
+	exit(-1);
+  }
+  headLimits = limits;
+}
+
+// For putting ranked heads back in order:
+static bool rankedByHead(const std::pair<float,int> &a, const std::pair<float,int> &b) {
+  return a.second < b.second;
+}
+
+// Cut one mod's heads down to the head limits, keeping them in order:
+void ArcFilter::limitHeads(HeadList &headList, HeadScores &headScores, FilterStats *stats) const {
+  int numHeads = headList.size();
+  if (numHeads <= 1)
+	return;
+  // Rank them, best first (and the nearer to the start on a tie):
+  std::vector<std::pair<float,int> > ranked(numHeads);
+  for (int i=0; i<numHeads; i++)
+	ranked[i] = std::make_pair(-headScores[i], headList[i]);
+  std::sort(ranked.begin(), ranked.end());
+  int kept = numHeads;
+  if (headLimits.topK > 0 && kept > headLimits.topK)
+	kept = headLimits.topK;
+  if (headLimits.margin >= 0) {
+	float lowest = -ranked[0].first - headLimits.margin;
+	while (kept > 1 && -ranked[kept-1].first < lowest)
+	  kept--;
+  }
+  if (kept == numHeads)
+	return;
+  if (stats != NULL) stats->pruned[PRUNE_HEAD_LIMIT] += numHeads - kept;
+  // Back in order:
+  std::sort(ranked.begin(), ranked.begin() + kept, rankedByHead);
+  headList.resize(kept);
+  headScores.resize(kept);
+  for (int i=0; i<kept; i++) {
+	headList[i] = ranked[i].second;
+	headScores[i] = -ranked[i].first;
+  }
+}
+
+// Filter a whole batch of sentences:
+void ArcFilter::filterBatch(const std::vector<Sentence> &sents, std::vector<HeadLists> &heads) const {
+  heads.resize(sents.size());
+  for (int i=0; i<(int)(sents.size()); i++)
+	filterSentence(sents[i], heads[i]);
+}
+
+// Preprocess, filter and write one input line:
+void ArcFilter::filterLine(char *line, int len, Sentence &sent, HeadLists &heads, std::ostream *out,
+						   OutputFormat format, FilterStats *stats, HeadScoreLists *scores) const {
+  uint64_t startNs = (stats != NULL) ? statsClock() : 0;
+  // Preprocess the line and read it into the word and tag arrays:
+  readSentence(line, len, sent.words, sent.tags);
+  if (stats != NULL) stats->stageNs[PARSE_STAGE] += statsClock() - startNs;
+  // Apply filters and output decisions:
+  filterSentence(sent, heads, stats, scores);
+  if (out != NULL) {
+	startNs = (stats != NULL) ? statsClock() : 0;
+	writeHeads(*out, sent, heads, format, scores);
+	if (stats != NULL) stats->stageNs[OUTPUT_STAGE] += statsClock() - startNs;
+  }
+}
+
+// Fill in the token-role filters from the rules and the linear predictions:
+template <int N>
+void ArcFilter::getRoleFilters(const StrVec &words, const StrVec &tags, RoleFilters<N> &f,
+							   float *tokenScores) const {
+  int sentSize = tags.size();
+  std::bitset<N> &headF = f.headF, &LxF = f.LxF, &L1F = f.L1F, &L5F = f.L5F;
+  std::bitset<N> &RxF = f.RxF, &R1F = f.R1F, &R5F = f.R5F, &rootF = f.rootF;
+
+  // The rules alone only know about heads and left-right mods:
+  if (!useLinear) {
+	for (int i=1; i<sentSize; i++) {
+	  if (tabooHeads.find(tags[i]) != tabooHeads.end())  // Heads:
+		headF.set(i, 1);
+	  if (noLeftHead.find(tags[i]) != noLeftHead.end())  // Left-filtering:
+		LxF.set(i, 1);
+	  if (noRightHead.find(tags[i]) != noRightHead.end())  // Right-filtering:
+		RxF.set(i, 1);
+	}
+	return;
+  }
+
+  // Predetermine which are heads, roots, and while we're at it, the left-right mods:
+  FeatureIds linFeats;
+  for (int i=1; i<sentSize; i++) {  // Go through each word:
+	// Create Feature Vector
+	linFeats.clear();
+	buildLinearFeatureIds(i, words, tags, sentSize, linFeats, &linTemplates);
+	// Get the filter predictions, as a bitmask
+	unsigned int preds = 0;
+	if (tokenScores != NULL) {
+	  float *scores = tokenScores + i * 8;
+	  sumLinearScores(linWeights, linFeats, scores);
+	  for (int k=0; k<8; k++)
+		if (scores[k] > LINEAR_THRESHOLD) preds |= 1 << k;
+	} else {
+	  preds = getLinearFilterMask(linWeights, linFeats);
+	}
+	// Use Predictions in conjunction with the Rules (if there are any)
+	bool noLeft = useRules && noLeftHead.find(tags[i]) != noLeftHead.end();
+	if (useRules && tabooHeads.find(tags[i]) != tabooHeads.end()) {    // Heads:
+	  headF.set(i, 1);
+	} else {
+	  headF.set(i, firesFilter(preds, HEAD_FILTER));
+	}
+	rootF.set(i, firesFilter(preds, ROOT_FILTER));  // Roots:
+	if (noLeft) {    // Left-filtering:
+	  LxF.set(i, 1);
+	} else {
+	  L1F.set(i, firesFilter(preds, L1_FILTER));
+	  L5F.set(i, firesFilter(preds, L5_FILTER));
+	}
+	if (useRules && noRightHead.find(tags[i]) != noRightHead.end()) {    // Right-filtering:
+	  RxF.set(i, 1);
+	} else {
+	  R1F.set(i, firesFilter(preds, R1_FILTER));
+	  R5F.set(i, firesFilter(preds, R5_FILTER));
+	  // If the rules said nothing about neither no-left nor no-right heads:
+	  if (!noLeft) {
+		RxF.set(i, firesFilter(preds, RX_FILTER));
+		LxF.set(i, firesFilter(preds, LX_FILTER));
+	  }
+	}
+  }
+}
+
+// The bits of word w (heads 64w..64w+63) that fall within [lo, hi]:
+static inline uint64_t rangeBits(int w, int lo, int hi) {
+  int base = w << 6;
+  if (lo > hi || hi < base || lo > base + 63) return 0;
+  uint64_t bits = ~(uint64_t)0;
+  if (lo > base) bits &= bits << (lo - base);
+  if (hi < base + 63) bits &= ~(uint64_t)0 >> (63 - (hi - base));
+  return bits;
+}
+
+// The heads in [lo, hi], bar the mod itself:
+static inline int intervalHeads(int lo, int hi, int mod) {
+  if (lo > hi) return 0;
+  return hi - lo + 1 - (lo <= mod && mod <= hi ? 1 : 0);
+}
+
+// The linear filter's score for an arc: how far below the threshold is
+// the strongest of the token-role filters that could prune it (the
+// head's head filter, and the mod's left-right ones):
+static inline float linearArcScore(const float *tokenScores, int head, int mod) {
+  const float *modS = tokenScores + mod * 8;
+  float strongest;
+  if (head < mod) {
+	strongest = std::max(std::max(modS[LX_FILTER], modS[R1_FILTER]), modS[R5_FILTER]);
+	if (head != mod-1) strongest = std::max(strongest, modS[L1_FILTER]);
+	if (mod - head > 5) strongest = std::max(strongest, modS[L5_FILTER]);
+  } else {
+	strongest = std::max(std::max(modS[RX_FILTER], modS[L1_FILTER]), modS[L5_FILTER]);
+	if (head != mod+1) strongest = std::max(strongest, modS[R1_FILTER]);
+	if (head - mod > 5) strongest = std::max(strongest, modS[R5_FILTER]);
+  }
+  if (head != 0)
+	strongest = std::max(strongest, tokenScores[head * 8 + HEAD_FILTER]);
+  return LINEAR_THRESHOLD - strongest;
+}
+
+// Narrow a mod's head interval to within [newLo, newHi], counting the
+// heads that drops against reason:
+static inline void narrowHeads(int &lo, int &hi, int newLo, int newHi, int mod,
+							   PruneReason reason, FilterStats *stats) {
+  newLo = std::max(lo, newLo);
+  newHi = std::min(hi, newHi);
+  if (stats != NULL)
+	stats->pruned[reason] += intervalHeads(lo, hi, mod) - intervalHeads(newLo, newHi, mod);
+  lo = newLo;
+  hi = newHi;
+}
+
+// Apply the rule filters as appropriate to limit the decisions made
+// by the linear filter values, then (for quad) apply the quad to the
+// stragglers.
+template <int N>
+void ArcFilter::roleFilter(const Sentence &sent, HeadLists &heads, FilterStats *stats,
+						   HeadScoreLists *scores) const {
+  const StrVec &tags = sent.tags;
+  int sentSize = tags.size();
+  RoleFilters<N> f;  // Store the filter decisions here:
+  const std::bitset<N> &headF = f.headF, &LxF = f.LxF, &L1F = f.L1F, &L5F = f.L5F;
+  const std::bitset<N> &RxF = f.RxF, &R1F = f.R1F, &R5F = f.R5F, &isRoot = f.rootF;
+
+  uint64_t stageNs = (stats != NULL) ? statsClock() : 0;
+  // The linear filter's head scores come from the token scores:
+  std::vector<float> tokenScores;
+  if (scores != NULL && filterType == LINEAR_FILTER)
+	tokenScores.assign(sentSize * 8, 0);
+  getRoleFilters(sent.words, tags, f, tokenScores.empty() ? NULL : &tokenScores[0]);
+  if (stats != NULL) {
+	uint64_t nowNs = statsClock();
+	stats->stageNs[LINEAR_STAGE] += nowNs - stageNs;
+	stageNs = nowNs;
+  }
+  int tagIds[N];  // For the pair rules and the quad
+  internTags(tags, tagIds);
+
+  // The root-filter is most interesting.  It affects things in two ways:
+  // a) in a projective parser, things can't cross it.  So each mod's
+  // heads lie between the nearest roots on either side of it (a root
+  // itself can be a head), found here by a scan in each direction:
+  int rootBefore[N], rootAfter[N];
+  for (int i = 1, last = 0; i < sentSize; i++) {
+	rootBefore[i] = last;
+	if (isRoot.test(i)) last = i;
+  }
+  for (int i = sentSize-1, next = sentSize-1; i > 0; i--) {
+	rootAfter[i] = next;
+	if (isRoot.test(i)) next = i;
+  }
+  bool anyRoot = isRoot.any();
+
+  // The rest is done on masks of heads, 64 to a word.  The heads that
+  // the token-role filters allow (the root is always a head):
+  const int WORDS = (N + 63) / 64;
+  int numWords = (sentSize + 63) / 64;
+  uint64_t headOk[WORDS];
+  for (int w=0; w<numWords; w++) headOk[w] = 0;
+  for (int i=0; i<sentSize; i++)
+	if (i == 0 || !headF.test(i)) headOk[i >> 6] |= (uint64_t)1 << (i & 63);
+  // And for the pair rules, for each mod tag, the heads it's a taboo
+  // pair with when the head comes first, and when it comes second;
+  // made as each tag is first seen:
+  int tabooSlot[MAXTAGS];
+  for (int t=0; t<numTags; t++) tabooSlot[t] = -1;
+  uint64_t tabooFirst[MAXTAGS][WORDS], tabooSecond[MAXTAGS][WORDS];
+  int numSlots = 0;
+  uint64_t unknownFirst[WORDS], unknownSecond[WORDS];
+
+  // Now find the arc possibilities for each mod:
+  for (int mod = 1; mod < sentSize; mod++) {  // An example for every modifier but the root:
+	HeadList &headList = heads[mod];    // the list of heads for mod-i:
+	// Narrow the heads down to an interval, from the roots and the
+	// left-right filters:
+	int lo = 0, hi = sentSize-1;
+	narrowHeads(lo, hi, rootBefore[mod], rootAfter[mod], mod, PRUNE_ROOT_CROSSING, stats);
+	if (LxF.test(mod)) narrowHeads(lo, hi, mod+1, hi, mod, PRUNE_LX, stats); // Roots are on the left...
+	if (RxF.test(mod)) narrowHeads(lo, hi, lo, mod-1, mod, PRUNE_RX, stats);
+	if (L1F.test(mod)) narrowHeads(lo, hi, mod-1, mod-1, mod, PRUNE_L1, stats);
+	if (R1F.test(mod)) narrowHeads(lo, hi, mod+1, mod+1, mod, PRUNE_R1, stats);
+	if (L5F.test(mod)) narrowHeads(lo, hi, mod-5, mod-1, mod, PRUNE_L5, stats);
+	if (R5F.test(mod)) narrowHeads(lo, hi, mod+1, mod+5, mod, PRUNE_R5, stats);
+	if (lo > hi) continue;
+
+	// The taboo-pair masks for this mod's tag:
+	const uint64_t *first, *second;
+	int modId = tagIds[mod];
+	if (modId >= 0 && tabooSlot[modId] >= 0) {
+	  first = tabooFirst[tabooSlot[modId]];
+	  second = tabooSecond[tabooSlot[modId]];
+	} else {
+	  // Make them, keeping them for the next mod with this tag:
+	  uint64_t *fm = unknownFirst, *sm = unknownSecond;
+	  if (modId >= 0) {
+		tabooSlot[modId] = numSlots;
+		fm = tabooFirst[numSlots]; sm = tabooSecond[numSlots];
+		numSlots++;
+	  }
+	  for (int w=0; w<numWords; w++) fm[w] = sm[w] = 0;
+	  for (int head = 0; head < sentSize; head++) {
+		uint64_t bit = (uint64_t)1 << (head & 63);
+		if (isTabooPair(true, tagIds[head], modId, tags[head], tags[mod])) fm[head >> 6] |= bit;
+		if (isTabooPair(false, tagIds[head], modId, tags[head], tags[mod])) sm[head >> 6] |= bit;
+	  }
+	  first = fm;
+	  second = sm;
+	}
+
+	for (int w = lo >> 6; w <= hi >> 6; w++) {
+	  // Words can't link to themselves:
+	  uint64_t inRange = rangeBits(w, lo, hi) & ~rangeBits(w, mod, mod);
+	  // The pair rules:
+	  uint64_t before = rangeBits(w, 0, mod-1);
+	  uint64_t taboo = (first[w] & before) | (second[w] & ~before);
+	  uint64_t candidates = inRange & headOk[w] & ~taboo;
+	  //  b) if we've picked out a root, no one else can be the root:
+	  if (w == 0 && anyRoot && !isRoot.test(mod))
+		candidates &= ~(uint64_t)1;
+	  if (stats != NULL) {
+		int numHeads = __builtin_popcountll(inRange & headOk[w]);
+		int numPairs = __builtin_popcountll(inRange & headOk[w] & ~taboo);
+		stats->pruned[PRUNE_HEAD] += __builtin_popcountll(inRange) - numHeads;
+		stats->pruned[PRUNE_TABOO_PAIR] += numHeads - numPairs;
+		stats->pruned[PRUNE_ROOT_TAKEN] += numPairs - __builtin_popcountll(candidates);
+	  }
+
+	  // Go through the heads that are left, in order:
+	  for (; candidates != 0; candidates &= candidates - 1) {
+		int head = (w << 6) + __builtin_ctzll(candidates);
+		headList.push_back(head);  // If we don't filter anything, put this on as an option
+	  }
+	}
+  }
+
+  // If they made it this far, it's time to use the quadratic filter on
+  // all of them:
+  if (stats != NULL) {
+	uint64_t nowNs = statsClock();
+	stats->stageNs[ARC_STAGE] += nowNs - stageNs;
+	stageNs = nowNs;
+  }
+  if (filterType == QUAD_FILTER) {
+	quadFilter(sent, tagIds, heads, stats, scores);
+	if (stats != NULL) stats->stageNs[QUAD_STAGE] += statsClock() - stageNs;
+  } else if (scores != NULL) {
+	for (int mod = 1; mod < sentSize; mod++) {
+	  HeadList &headList = heads[mod];
+	  HeadScores &headScores = (*scores)[mod];
+	  // The rules have no scores:
+	  if (filterType == RULE_FILTER) {
+		headScores.assign(headList.size(), 0);
+		continue;
+	  }
+	  for (int i=0; i<(int)(headList.size()); i++)
+		headScores.push_back(linearArcScore(&tokenScores[0], headList[i], mod));
+	  if (headLimits.active()) {
+		if (headList.empty()) {
+		  // Give it back its best head:
+		  int bestHead = -1;
+		  float bestScore = 0;
+		  for (int head = 0; head < sentSize; head++) {
+			if (head == mod) continue;
+			float score = linearArcScore(&tokenScores[0], head, mod);
+			if (bestHead < 0 || score > bestScore) { bestHead = head; bestScore = score; }
+		  }
+		  headList.push_back(bestHead);
+		  headScores.push_back(bestScore);
+		  if (stats != NULL) stats->arcsRestored++;
+		}
+		limitHeads(headList, headScores, stats);
+	  }
+	}
+  }
+}
+
+// Which of the token-role filters, if any, prunes an arc:
+template <int N>
+static inline int roleTest(const RoleFilters<N> &f, int head, int mod) {
+  if (f.LxF.test(mod) && head < mod) return PRUNE_LX;
+  if (f.RxF.test(mod) && head > mod) return PRUNE_RX;
+  if (f.L1F.test(mod) && head != mod-1) return PRUNE_L1;
+  if (f.R1F.test(mod) && head != mod+1) return PRUNE_R1;
+  if (f.L5F.test(mod) && (head < mod-5 || head > mod-1)) return PRUNE_L5;
+  if (f.R5F.test(mod) && (head < mod+1 || head > mod+5)) return PRUNE_R5;
+  if (head != 0 && f.headF.test(head)) return PRUNE_HEAD;
+  return -1;
+}
+
+// A cascade: the token-role filters once per sentence, then each stage
+// in turn over the arcs the stages before it kept, so the costly ones
+// (the quad above all) only see the arcs the cheap ones let through:
+template <int N>
+void ArcFilter::cascadeFilter(const Sentence &sent, HeadLists &heads, FilterStats *stats,
+							  HeadScoreLists *scores) const {
+  const StrVec &tags = sent.tags;
+  int sentSize = tags.size();
+  RoleFilters<N> f;
+
+  uint64_t stageNs = (stats != NULL) ? statsClock() : 0;
+  // The linear filter's head scores come from the token scores:
+  std::vector<float> tokenScores;
+  if (useLinear && scores != NULL && scoreStage == NUMCASCADESTAGES)
+	tokenScores.assign(sentSize * 8, 0);
+  if (useRules || useLinear)
+	getRoleFilters(sent.words, tags, f, tokenScores.empty() ? NULL : &tokenScores[0]);
+  int tagIds[N];
+  internTags(tags, tagIds);
+  // Each mod's heads lie between the nearest roots on either side of it:
+  int rootBefore[N], rootAfter[N];
+  for (int i = 1, last = 0; i < sentSize; i++) {
+	rootBefore[i] = last;
+	if (f.rootF.test(i)) last = i;
+  }
+  for (int i = sentSize-1, next = sentSize-1; i > 0; i--) {
+	rootAfter[i] = next;
+	if (f.rootF.test(i)) next = i;
+  }
+  bool anyRoot = f.rootF.any();
+  if (stats != NULL) {
+	uint64_t nowNs = statsClock();
+	stats->stageNs[LINEAR_STAGE] += nowNs - stageNs;
+	stageNs = nowNs;
+  }
+
+  // Every arc, to start with:
+  for (int mod = 1; mod < sentSize; mod++) {
+	HeadList &headList = heads[mod];
+	for (int head = 0; head < sentSize; head++)
+	  if (head != mod) headList.push_back(head);
+  }
+
+  // The quad's fragments, made if any arcs get that far:
+  QuadFragments frags;
+  bool haveFrags = false;
+  bool scored = false;  // Do the arcs have their scores yet?
+  for (int s=0; s<(int)(cascade.stages.size()); s++) {
+	CascadeStage stage = cascade.stages[s];
+	bool scoring = (scores != NULL && stage == scoreStage);
+	uint64_t arcsIn = 0, arcsKept = 0;
+	for (int mod = 1; mod < sentSize; mod++) {
+	  HeadList &headList = heads[mod];
+	  HeadScores *headScores = (scored || scoring) ? &(*scores)[mod] : NULL;
+	  if (scoring) headScores->resize(headList.size());
+	  int numHeads = headList.size();
+	  int kept = 0;
+	  for (int i=0; i<numHeads; i++) {
+		int head = headList[i];
+		int pruned = -1;  // Or the PruneReason, if it's filtered
+		float score = 0;
+		switch (stage) {
+		case CASCADE_ROLES:
+		  pruned = roleTest(f, head, mod);
+		  break;
+		case CASCADE_ROOTS:
+		  if (head < rootBefore[mod] || head > rootAfter[mod]) pruned = PRUNE_ROOT_CROSSING;
+		  else if (head == 0 && anyRoot && !f.rootF.test(mod)) pruned = PRUNE_ROOT_TAKEN;
+		  break;
+		case CASCADE_TABOO:
+		  if (isTabooPair(head < mod, tagIds[head], tagIds[mod], tags[head], tags[mod])) pruned = PRUNE_TABOO_PAIR;
+		  break;
+		case CASCADE_QUAD:
+		  if (!haveFrags) {
+			buildQuadFragments(sent.words, tags, sentSize, frags);
+			haveFrags = true;
+		  }
+		  score = quadScore(head, mod, sent, tagIds, frags);
+		  if (!(score > QUAD_THRESHOLD)) pruned = PRUNE_QUAD_SCORE;
+		  break;
+		case CASCADE_PAIR:
+		  score = pairScore(head, mod, tagIds, tags);
+		  if (score < 0) pruned = PRUNE_PAIR_SCORE;
+		  break;
+		default:
+		  break;
+		}
+		if (pruned < 0) {
+		  if (headScores != NULL) (*headScores)[kept] = scoring ? score : (*headScores)[i];
+		  headList[kept++] = head;
+		} else if (stats != NULL) {
+		  stats->pruned[pruned]++;
+		}
+	  }
+	  headList.resize(kept);
+	  if (headScores != NULL) headScores->resize(kept);
+	  arcsIn += numHeads;
+	  arcsKept += kept;
+	}
+	if (scoring) scored = true;
+	if (stats != NULL) {
+	  uint64_t nowNs = statsClock();
+	  stats->cascadeArcs[stage] += arcsIn;
+	  stats->cascadeKept[stage] += arcsKept;
+	  stats->cascadeNs[stage] += nowNs - stageNs;
+	  stats->stageNs[stage == CASCADE_QUAD ? QUAD_STAGE : ARC_STAGE] += nowNs - stageNs;
+	  stageNs = nowNs;
+	}
+  }
+  if (scores == NULL)
+	return;
+
+  // Scores from the linear filter (or none, for the rules alone), and
+  // the head limits:
+  for (int mod = 1; mod < sentSize; mod++) {
+	HeadList &headList = heads[mod];
+	HeadScores &headScores = (*scores)[mod];
+	if (!scored) {
+	  for (int i=0; i<(int)(headList.size()); i++)
+		headScores.push_back(useLinear ? linearArcScore(&tokenScores[0], headList[i], mod) : 0);
+	}
+	if (!headLimits.active())
+	  continue;
+	if (headList.empty()) {
+	  // Give it back its best head:
+	  if (scoreStage == CASCADE_QUAD && !haveFrags) {
+		buildQuadFragments(sent.words, tags, sentSize, frags);
+		haveFrags = true;
+	  }
+	  int bestHead = -1;
+	  float bestScore = 0;
+	  for (int head = 0; head < sentSize; head++) {
+		if (head == mod) continue;
+		float score;
+		if (scoreStage == CASCADE_QUAD) score = quadScore(head, mod, sent, tagIds, frags);
+		else if (scoreStage == CASCADE_PAIR) score = pairScore(head, mod, tagIds, tags);
+		else score = linearArcScore(&tokenScores[0], head, mod);
+		if (bestHead < 0 || score > bestScore) { bestHead = head; bestScore = score; }
+	  }
+	  headList.push_back(bestHead);
+	  headScores.push_back(bestScore);
+	  if (stats != NULL) stats->arcsRestored++;
+	}
+	limitHeads(headList, headScores, stats);
+  }
+}
+
+// The ultra filter: token-role scores against tag-pair scores:
+template <int N>
+void ArcFilter::ultraFilter(const Sentence &sent, HeadLists &heads, FilterStats *stats,
+							HeadScoreLists *scores) const {
+  const StrVec &words = sent.words;
+  const StrVec &tags = sent.tags;
+  int sentSize = tags.size();
+  uint64_t stageNs = (stats != NULL) ? statsClock() : 0;
+
+  ////////////////////////////////////////////////////////////////////////
+  // STEP 1: Precompute what you can from the sentence in linear time (one pass)
+  ////////////////////////////////////////////////////////////////////////
+  // 1) Predetermine which of the nodes might be roots and store in here:
+  ScratchArray<bool,N> possibleRootBool(sentSize); possibleRootBool[0] = 0; // No need to check artificial root
+  // 2) Predetermine the token-role filter scores for all the nodes in linear time:
+  ScratchArray<float,N> headS(sentSize), LxS(sentSize), RxS(sentSize), L1S(sentSize), L5S(sentSize),
+	R1S(sentSize), R5S(sentSize), rootS(sentSize);
+  // Put zeros in these so you don't have to re-adjust the offset later: (these correspond to the artificial root)
+  headS[0] = 0; rootS[0] = 0;
+  LxS[0] = 0; L1S[0] = 0; L5S[0] = 0;
+  RxS[0] = 0; R1S[0] = 0; R5S[0] = 0;
+  // 3) For speed, intern the tags for the pair lookups (the root's pairs are always "hROOT"):
+  ScratchArray<int,N> tagIds(sentSize);
+  internTags(tags, &tagIds[0]);
+  tagIds[0] = rootTagId;
+  // 4) Now get the linear-pass information:
+  FeatureIds linFeats;
+  for (int i=1; i<sentSize; i++) {  // Go through each word:
+	// a) First, check if root:
+	possibleRootBool[i] = (tags[i] == "VBD" || tags[i] == "VBZ" || tags[i] == "VBP" || tags[i] == "MD");
+	// b) Then, get the scores:
+	linFeats.clear(); // i) Create Feature Vector
+	buildLinearFeatureIds(i, words, tags, sentSize, linFeats, &linTemplates);
+	float preds[8];    // ii) Get the filter predictions (scores):
+	sumLinearScores(linWeights, linFeats, preds);
+	headS[i] = preds[0]; rootS[i] = preds[1]; /// iii) Stick on the scores
+	LxS[i] = preds[2]; L1S[i] = preds[3]; L5S[i] = preds[4];
+	RxS[i] = preds[5]; R1S[i] = preds[6]; R5S[i] = preds[7];
+  }
+  if (stats != NULL) {
+	uint64_t nowNs = statsClock();
+	stats->stageNs[LINEAR_STAGE] += nowNs - stageNs;
+	stageNs = nowNs;
+  }
+  ////////////////////////////////////////////////////////////////////////
+  // STEP 2: Go through all arcs (quadratic loop), finding possible heads for each mod
+  ////////////////////////////////////////////////////////////////////////
+  static const std::string rootTag = "ROOT";
+  for (int mod = 1; mod < sentSize; mod++) {  // An example for every modifier but the root:
+	HeadList &headList = heads[mod];    // the list of heads for mod-i:
+	int modId = tagIds[mod];
+	// For speed, do everything knowing the order of head and mod, in three blocks:
+	////////////////////////////////////////////////////////////////////////
+	// BLOCK 1: head == 0
+	////////////////////////////////////////////////////////////////////////
+	{ // int head = 0
+	  int pruned = -1;  // Or the PruneReason, if it's filtered
+	  // Look up the weights on this tag pair + distance for none/pair:
+	  const float *finder = pairRow(true, rootTagId, modId, rootTag, tags[mod]);
+	  float noneScore = noneBias + finder[0] * mod; float pairScore = pairBias + finder[1] * mod;
+	  if (pairScore > noneScore) pruned = PRUNE_PAIR_SCORE;
+	  else if (LxS[mod] > noneScore) pruned = PRUNE_LX;
+	  else if (R1S[mod] > noneScore) pruned = PRUNE_R1;
+	  else if (R5S[mod] > noneScore) pruned = PRUNE_R5;
+	  else if (L1S[mod] > noneScore && mod != 1) pruned = PRUNE_L1;
+	  else if (L5S[mod] > noneScore && mod>5) pruned = PRUNE_L5;
+	  else
+		// See if there's another root, in which case this guy can't be the root:
+		for (int i=1; i<sentSize && pruned < 0; i++)
+		  if (i != mod && possibleRootBool[i] && rootS[i] > noneScore) pruned = PRUNE_ROOT_TAKEN;
+	  if (pruned < 0) {
+		headList.push_back(0);
+		if (scores != NULL) (*scores)[mod].push_back(noneScore - pairScore);
+	  } else if (stats != NULL) {
+		stats->pruned[pruned]++;
+	  }
+	}
+
+	////////////////////////////////////////////////////////////////////////
+	// BLOCK 2: head < mod:
+	////////////////////////////////////////////////////////////////////////
+	for (int head = 1; head < mod; head++) {    // Go through all the possible heads:
+	  int pruned = -1;
+	  // Look up the weights on this tag pair + distance for none/pair:
+	  const float *finder = pairRow(true, tagIds[head], modId, tags[head], tags[mod]);
+	  int distance = mod - head;
+	  float noneScore = noneBias + finder[0] * distance; float pairScore = pairBias + finder[1] * distance;
+	  if (pairScore > noneScore) pruned = PRUNE_PAIR_SCORE;
+	  else if (headS[head] > noneScore) pruned = PRUNE_HEAD;
+	  else if (LxS[mod] > noneScore) pruned = PRUNE_LX;
+	  else if (R1S[mod] > noneScore) pruned = PRUNE_R1;
+	  else if (R5S[mod] > noneScore) pruned = PRUNE_R5;
+	  else if (L1S[mod] > noneScore && head != mod-1) pruned = PRUNE_L1;
+	  else if (L5S[mod] > noneScore && (mod-head>5)) pruned = PRUNE_L5;
+	  else
+		// Now, see if there's a root that can filter you: Go through
+		// all the nodes between mod and head (or head and mod):
+		for (int i = head + 1; i < mod && pruned < 0; i++)
+		  if (possibleRootBool[i] && rootS[i] > noneScore) // Check: can this node be a root?
+			pruned = PRUNE_ROOT_CROSSING;
+	  if (pruned < 0) {
+		headList.push_back(head);
+		if (scores != NULL) (*scores)[mod].push_back(noneScore - pairScore);
+	  } else if (stats != NULL) {
+		stats->pruned[pruned]++;
+	  }
+	}
+
+	////////////////////////////////////////////////////////////////////////
+	// BLOCK 3: mod < head:
+	////////////////////////////////////////////////////////////////////////
+	for (int head = mod+1; head < sentSize; head++) {    // Go through all the possible heads:
+	  int pruned = -1;
+	  // Look up the weights on this tag pair + distance for none/pair:
+	  const float *finder = pairRow(false, tagIds[head], modId, tags[head], tags[mod]);
+	  int distance = head - mod;
+	  float noneScore = noneBias + finder[0] * distance; float pairScore = pairBias + finder[1] * distance;
+	  if (pairScore > noneScore) pruned = PRUNE_PAIR_SCORE;
+	  else if (headS[head] > noneScore) pruned = PRUNE_HEAD;
+	  else if (RxS[mod] > noneScore) pruned = PRUNE_RX;
+	  else if (L1S[mod] > noneScore) pruned = PRUNE_L1;
+	  else if (L5S[mod] > noneScore) pruned = PRUNE_L5;
+	  else if (R1S[mod] > noneScore && head != mod+1) pruned = PRUNE_R1;
+	  else if (R5S[mod] > noneScore && (head-mod>5)) pruned = PRUNE_R5;
+	  else
+		// Look for a root between them
+		for (int i = mod + 1; i < head && pruned < 0; i++)
+		  if (possibleRootBool[i] && rootS[i] > noneScore)
+			pruned = PRUNE_ROOT_CROSSING;
+	  if (pruned < 0) {
+		headList.push_back(head);
+		if (scores != NULL) (*scores)[mod].push_back(noneScore - pairScore);
+	  } else if (stats != NULL) {
+		stats->pruned[pruned]++;
+	  }
+	}
+
+	if (scores != NULL && headLimits.active()) {
+	  HeadScores &headScores = (*scores)[mod];
+	  if (headList.empty()) {
+		// Give it back its best head:
+		int bestHead = -1;
+		float bestScore = 0;
+		for (int head = 0; head < sentSize; head++) {
+		  if (head == mod) continue;
+		  const float *finder = pairRow(head < mod, tagIds[head], modId, head == 0 ? rootTag : tags[head], tags[mod]);
+		  int distance = (head < mod) ? mod - head : head - mod;
+		  float noneScore = noneBias + finder[0] * distance; float pairScore = pairBias + finder[1] * distance;
+		  if (bestHead < 0 || noneScore - pairScore > bestScore) { bestHead = head; bestScore = noneScore - pairScore; }
+		}
+		headList.push_back(bestHead);
+		headScores.push_back(bestScore);
+		if (stats != NULL) stats->arcsRestored++;
+	  }
+	  limitHeads(headList, headScores, stats);
+	}
+  }
+  if (stats != NULL) stats->stageNs[ARC_STAGE] += statsClock() - stageNs;
+}
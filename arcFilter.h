@@ -0,0 +1,373 @@
+/******************************************
+ *
+ * arcFilter.h
+ *
+ * The four filter engines (rule, linear, quad and ultra), and cascades
+ * of their stages, behind one object that loads its rules and weights
+ * once and can then be shared, read-only, by any number of threads.
+ *
+ ******************************************/
+
+#ifndef ARCFILTER_H
+#define ARCFILTER_H
+
+#include <iostream>   // For the stream driver
+
+#include "filterCommon.h"
+#include "weightTable.h"
+#include "filterStats.h"
+
+// Which combination of filters to apply:
+enum FilterType { RULE_FILTER, LINEAR_FILTER, QUAD_FILTER, ULTRA_FILTER, CASCADE_FILTER };
+
+// A cascade of filter stages, as read from a config file with one of
+// these on each line ('#' starts a comment):
+//   rules             Use the rule lists in the roles stage
+//   linear FILE       The linear weights, for the roles and roots stages
+//   quad FILE         The quad weights, for the quad stage
+//   pair FILE         The ultra filter's pair weights, for the pair stage
+//   stages S1 S2 ...  The stages to run over the arcs, in order, from
+//                     roles, roots, taboo, quad and pair (see CascadeStage)
+//   order cost FILE   Then reorder them by their cost per arc pruned,
+//                     measured on the sentences in FILE
+// Each stage only prunes arcs, so the order changes the time taken but
+// not the decisions.  With rules, linear weights and the stages roles,
+// roots and taboo, it's the linear filter, and adding quad makes it the
+// quad filter; rules with roles and taboo are the rule filter (bar the
+// rule filter's text format).  The ultra filter holds the token roles
+// to each arc's pair score rather than to their thresholds, so it has
+// no cascade; the pair stage is just its pair-score test.
+struct FilterCascade {
+  bool rules;
+  std::string linearFile, quadFile, pairFile;  // "" for none
+  std::vector<CascadeStage> stages;
+  std::string sampleFile;  // To order the stages on, or "" to keep them as given
+  FilterCascade() : rules(false) {}
+};
+
+// Read a cascade's config file, or stop the program if it's bad:
+void readCascade(const char *filename, FilterCascade &cascade);
+
+// One input sentence; position 0 holds the artificial root:
+struct Sentence {
+  StrVec words;
+  StrVec tags;
+};
+
+// The possible heads of one mod:
+typedef std::vector<int> HeadList;
+// The possible heads of every mod in a sentence, indexed by mod (the
+// entry for the root at position 0 always stays empty):
+typedef std::vector<HeadList> HeadLists;
+
+// The filter's score for each of a mod's heads, in the order of its
+// HeadList, and for every mod.  Higher scores are surer heads: the quad
+// score for the quad filter, noneScore - pairScore for the ultra, and
+// for the linear filter, how far the arc is from tripping the strongest
+// token-role filter that could prune it:
+typedef std::vector<float> HeadScores;
+typedef std::vector<HeadScores> HeadScoreLists;
+
+// Limits on the heads each mod keeps after filtering, by their scores:
+// at most topK (0 for any number), and only those within margin of the
+// best (a negative margin for no limit).  With either set, a mod the
+// filters leave without any heads gets its best-scoring one back, so
+// that every mod has at least one.
+struct HeadLimits {
+  int topK;
+  float margin;
+  HeadLimits() : topK(0), margin(-1) {}
+  bool active() const { return topK > 0 || margin >= 0; }
+};
+
+// The formats the decisions can be written in.  The binary ones write
+// one record per sentence, each starting with a uint32 count of the
+// bytes in the rest of the record, then n, the number of tokens
+// (counting the root; 0 for an empty line, or a sentence that couldn't
+// be filtered).  All fields are in the machine's own byte order.  With
+// scores, the text format writes each head as head:score, and the
+// binary ones end each record with float32 scores[], one per head in
+// the order of the heads (mod by mod, each mod's in order), unaligned.
+enum OutputFormat {
+  TEXT_OUTPUT,   // The original text, one line per sentence
+  CSR_OUTPUT,    // uint32 offsets[n+1], then uint16 heads[offsets[n]]:
+				 // the heads of mod m are heads[offsets[m]..offsets[m+1])
+  BITS_OUTPUT    // n rows (one per mod, row 0 for the root) of (n+63)/64
+				 // uint64 words: bit h of a row is set if h may head it
+};
+
+// Options common to all the filter programs, given as "--name value"
+// anywhere on the command line:
+struct FilterOptions {
+  int numThreads;       // --threads N: filter on N worker threads
+  OutputFormat format;  // --format text|csr|bits
+  bool withScores;      // --scores: write each head's score too (not for the rule filter)
+  const char *statsFile;  // --stats FILE: write FilterStats there as JSON at the end
+  double statsInterval;   // --stats-interval SECONDS: and this often along the way
+  HeadLimits headLimits;  // --top-k K, --head-margin M: for ArcFilter::setHeadLimits
+  const char *socketPath; // --serve SOCKET: answer clients there, rather than filter stdin
+  FilterOptions()
+	: numThreads(1), format(TEXT_OUTPUT), withScores(false), statsFile(NULL), statsInterval(0),
+	  socketPath(NULL) {}
+};
+
+class OutputBuffer;
+
+// The margins to sweep when evaluating against gold heads: a filter
+// only prunes an arc when its score beats its threshold by more than
+// the margin, so bigger margins keep more arcs.  The role margins go on
+// the token-role filters (linear, quad and ultra), the score margins
+// on the quad score or the ultra pair score:
+struct MarginGrid {
+  std::vector<float> roleMargins;
+  std::vector<float> scoreMargins;
+};
+
+// What a sweep counts, with one entry per setting of the grid (role
+// margin r and score margin s at [r * scoreMargins.size() + s]):
+struct SweepCounts {
+  uint64_t sentences;       // Sentences swept
+  uint64_t unfitSentences;  // And ones too long to filter
+  uint64_t goldArcs;        // Arcs with a gold head given
+  uint64_t arcs;            // Every head for every mod, bar itself
+  std::vector<uint64_t> goldKept, arcsKept;
+  SweepCounts(const MarginGrid &grid)
+	: sentences(0), unfitSentences(0), goldArcs(0), arcs(0),
+	  goldKept(grid.roleMargins.size() * grid.scoreMargins.size()),
+	  arcsKept(grid.roleMargins.size() * grid.scoreMargins.size()) {}
+};
+
+// Take any options out of argv, leaving nargin and argv with just the
+// program name and the other arguments.  Returns false on a bad option.
+bool parseFilterOptions(int &nargin, char **argv, FilterOptions &opts);
+
+// The size classes of sentences (counting the root) that the engines
+// are specialized for; longer ones take the general versions:
+const int SMALLSENTSIZE = 64;    // Role filters in one machine word
+const int MEDIUMSENTSIZE = 256;
+
+// The token-role filter decisions for a sentence of up to N tokens:
+template <int N> struct RoleFilters {
+  std::bitset<N> headF, LxF, L1F, L5F, RxF, R1F, R5F;
+  std::bitset<N> rootF;    // The predicted roots
+};
+
+class ArcFilter {
+ public:
+  // Load the rule lists plus the weights needed by this filter type.
+  // The linear, quad and ultra filters take the linear weights as
+  // weightsA; quad takes the quad weights and ultra the pair weights
+  // as weightsB.  Unused files may be NULL.  Each file may be either
+  // text weights or a model compiled by compileModel.
+  ArcFilter(FilterType type, const char *weightsA, const char *weightsB);
+  // Load the rules and weights a cascade's stages need, ordering the
+  // stages if it says to (see arcCascade.cpp):
+  explicit ArcFilter(const FilterCascade &config);
+
+  FilterType type() const { return filterType; }
+  // Does it score the arcs it keeps?  (The rules alone don't.)
+  bool hasScores() const;
+
+  // Load this filter again from the same weight files, with the same
+  // head limits, to pick up retrained weights.  Returns NULL, keeping
+  // the caller on the old weights, if a file can't be opened now.
+  ArcFilter *reload() const;
+  // Free the weights, once nothing will filter with this one again:
+  void releaseWeights();
+
+  // Limit the heads each mod keeps from now on.  Not for the rule
+  // filter, or a cascade of the rules alone, which have no scores to
+  // rank them by.  Call this before sharing the filter between threads.
+  void setHeadLimits(const HeadLimits &limits);
+
+  // Can this sentence be filtered at all? (The bitset-based filters
+  // have a maximum sentence size.)
+  bool fits(const Sentence &sent) const;
+
+  // Find the possible heads of every mod in one sentence.  Returns
+  // false, with no heads, if the sentence doesn't fit.  If stats isn't
+  // NULL, the sentence is counted there, and if scores isn't, it gets
+  // the heads' scores (all 0 for the rule filter).
+  bool filterSentence(const Sentence &sent, HeadLists &heads, FilterStats *stats = NULL,
+					  HeadScoreLists *scores = NULL) const;
+
+  // Filter a whole batch of sentences; heads[i] is the result for sents[i]:
+  void filterBatch(const std::vector<Sentence> &sents, std::vector<HeadLists> &heads) const;
+
+  // Filter one sentence at every setting of the grid at once, counting
+  // in counts how many arcs, and how many of the gold ones (goldHeads[m]
+  // for mod m, where it's in the sentence), each setting keeps.  With
+  // all margins 0 the decisions are the same as filterSentence's.  A
+  // cascade has no margins, so it makes its own decisions at every one.
+  void sweepSentence(const Sentence &sent, const std::vector<int> &goldHeads,
+					 const MarginGrid &grid, SweepCounts &counts) const;
+
+  // Write one sentence's decisions in the given format, with the heads'
+  // scores unless scores is NULL:
+  void writeHeads(std::ostream &out, const Sentence &sent, const HeadLists &heads,
+				  OutputFormat format = TEXT_OUTPUT, const HeadScoreLists *scores = NULL) const;
+
+  // Read word_tag_head lines from in, write one line of decisions per
+  // sentence to out.  Pass out == NULL to filter without any output.
+  // With more than one thread, a reader hands batches of lines to a
+  // pool of workers, and the output still comes out in input order.
+  // Stats are only kept if opts.statsFile is given.
+  void filterStream(std::istream &in, std::ostream *out, const FilterOptions &opts = FilterOptions()) const;
+
+  // Answer clients on the Unix socket opts.socketPath until SIGINT or
+  // SIGTERM, with opts.numThreads workers (see arcServer.cpp).  Each
+  // client writes word_tag_head lines and gets back their decisions, in
+  // order, just as filterStream would write them.  On SIGHUP, the
+  // weights are reloaded in the background and swapped in; once that
+  // happens, this filter's own weights are freed as soon as nothing is
+  // using them, so it can't filter anything after serve returns.
+  void serve(const FilterOptions &opts);
+
+  // Preprocess, filter and (if out != NULL) write one input line,
+  // using the caller's scratch space.  The line is normalized in place.
+  // If scores isn't NULL, the heads' scores are found and written too.
+  void filterLine(char *line, int len, Sentence &sent, HeadLists &heads, std::ostream *out,
+				  OutputFormat format = TEXT_OUTPUT, FilterStats *stats = NULL,
+				  HeadScoreLists *scores = NULL) const;
+
+ private:
+  // Write the decisions in each format:
+  void writeText(OutputBuffer &buf, const Sentence &sent, const HeadLists &heads,
+				 const HeadScoreLists *scores) const;
+  void writeCsr(OutputBuffer &buf, const Sentence &sent, const HeadLists &heads,
+				const HeadScoreLists *scores) const;
+  void writeBits(OutputBuffer &buf, const Sentence &sent, const HeadLists &heads,
+				 const HeadScoreLists *scores) const;
+
+  // The engines come in one version per size class, for sentences of
+  // up to N tokens (counting the root), with all their per-sentence
+  // state held on the stack.  N == 0 means any size, on the heap.
+
+  // The rule, linear and quad filters: prune arcs with the token-role
+  // filters, then (for quad) score the survivors.  Each counts what it
+  // prunes, and times its stages, in stats unless that's NULL, and
+  // (unless that's NULL) gives the heads' scores and applies the head
+  // limits:
+  template <int N> void roleFilter(const Sentence &sent, HeadLists &heads, FilterStats *stats,
+								   HeadScoreLists *scores) const;
+  // The ultra filter: token-role scores against tag-pair scores:
+  template <int N> void ultraFilter(const Sentence &sent, HeadLists &heads, FilterStats *stats,
+									HeadScoreLists *scores) const;
+  // A cascade: the token-role filters once per sentence, then each of
+  // its stages in turn, over the arcs the ones before it kept:
+  template <int N> void cascadeFilter(const Sentence &sent, HeadLists &heads, FilterStats *stats,
+									  HeadScoreLists *scores) const;
+  // Order a cascade's stages by their cost per arc pruned on a sample:
+  void orderCascade(const char *sampleFile);
+  // Cut one mod's heads down to the head limits:
+  void limitHeads(HeadList &headList, HeadScores &headScores, FilterStats *stats) const;
+
+  // The sweeps of the rule, linear and quad filters, of the ultra, and
+  // of a cascade:
+  void sweepRoleFilter(const Sentence &sent, const std::vector<int> &goldHeads,
+					   const MarginGrid &grid, SweepCounts &counts) const;
+  void sweepUltraFilter(const Sentence &sent, const std::vector<int> &goldHeads,
+						const MarginGrid &grid, SweepCounts &counts) const;
+  void sweepCascade(const Sentence &sent, const std::vector<int> &goldHeads,
+					const MarginGrid &grid, SweepCounts &counts) const;
+
+  // Load the rule lists and the tag set:
+  void loadRules();
+  // Load the quad weights, and the tables made from them:
+  void loadQuad(const char *weightsFile);
+  // Load the pair weights, and the tables made from them:
+  void loadPair(const char *weightsFile);
+
+  // Compile the pair weights into pairMatrix, over the tag set:
+  void buildPairMatrix();
+  // The (none, pair) weights of a head and mod tag, from pairMatrix
+  // when both tags are in the tag set, else from the pair weights:
+  inline const float *pairRow(bool headFirst, int headId, int modId,
+							  const std::string &headTag, const std::string &modTag) const {
+	if (headId >= 0 && modId >= 0)
+	  return &pairMatrix[(((headFirst ? 0 : 1) * numTags + headId) * numTags + modId) * 2];
+	return findPairRow(headFirst, headTag, modTag);
+  }
+  const float *findPairRow(bool headFirst, const std::string &headTag, const std::string &modTag) const;
+  // The ultra filter's score for an arc, noneScore - pairScore; it
+  // prunes the arc if that's below 0:
+  inline float pairScore(int head, int mod, const int *tagIds, const StrVec &tags) const {
+	static const std::string rootTag = "ROOT";
+	int distance = (head < mod) ? mod - head : head - mod;
+	const float *finder = (head == 0)
+	  ? pairRow(true, rootTagId, tagIds[mod], rootTag, tags[mod])
+	  : pairRow(head < mod, tagIds[head], tagIds[mod], tags[head], tags[mod]);
+	return (noneBias + finder[0] * distance) - (pairBias + finder[1] * distance);
+  }
+
+  // Compile the taboo pairs into tabooMatrix, over the tag set:
+  void buildTabooMatrix();
+  // Is this a taboo pair of tags?  From tabooMatrix when both tags are
+  // in the tag set, else from the taboo list:
+  inline bool isTabooPair(bool headFirst, int headId, int modId,
+						  const std::string &headTag, const std::string &modTag) const {
+	if (headId >= 0 && modId >= 0)
+	  return tabooMatrix[((headFirst ? 0 : 1) * numTags + headId) * numTags + modId];
+	if (headFirst)
+	  return tabooPairs.find("h" + headTag + "<m" + modTag) != tabooPairs.end();
+	return tabooPairs.find("m" + modTag + "<h" + headTag) != tabooPairs.end();
+  }
+  // Compile the quad weights of the head and mod tags and direction
+  // alone into quadTagMatrix and the scalars beside it:
+  void buildQuadTagMatrix();
+  // The quad filter's second pass, over the arcs the first one kept:
+  void quadFilter(const Sentence &sent, const int *tagIds, HeadLists &heads, FilterStats *stats,
+				  HeadScoreLists *scores) const;
+  // The quad filter's score for one arc:
+  float quadScore(int head, int mod, const Sentence &sent, const int *tagIds,
+				  const QuadFragments &frags) const;
+
+  // Look up each tag's ID in the tag set (-1 if it's not there):
+  void internTags(const StrVec &tags, int *tagIds) const;
+
+  // Fill in the token-role filters from the rules and (unless this is
+  // the rule filter) the linear filter predictions, keeping each token's
+  // eight linear scores in tokenScores unless that's NULL:
+  template <int N>
+  void getRoleFilters(const StrVec &words, const StrVec &tags, RoleFilters<N> &f,
+					  float *tokenScores = NULL) const;
+
+  FilterType filterType;
+  bool useRules, useLinear;  // For the token-role filters
+  HeadLimits headLimits;
+  // Where the weights came from, for reload ("" for none):
+  std::string weightsFileA, weightsFileB;
+  // A cascade's config, with its stages in the order they're run, and
+  // the stage whose scores its arcs get (NUMCASCADESTAGES for the
+  // linear filter's):
+  FilterCascade cascade;
+  CascadeStage scoreStage;
+
+  RuleLists tabooHeads, noLeftHead, noRightHead, tabooPairs;
+  WeightTable linWeights;
+  WeightTable quadWeights;
+  WeightTable pairWeights;
+  // The feature templates the linear and quad weights have any of:
+  TemplateMask linTemplates, quadTemplates;
+
+  std::vector<float> logPrecomputes;  // For the quad's log distances and counts
+  float noneBias, pairBias;           // For the ultra's none/pair filters
+
+  // The tags, interned as 0..numTags-1 for the dense tables below:
+  TagIndex tagSet;
+  int numTags;
+  int rootTagId;
+  // The taboo pairs as a dense [dir][headTag][modTag] array, dir 0
+  // being head-first:
+  std::vector<bool> tabooMatrix;
+  // The quad's tag-only weights: per [headTag][modTag][dir], the key
+  // triple's weight and the th+tm weight on the log distance; and per
+  // dir, the direction's weight and the "D"+direction one:
+  std::vector<float> quadTagMatrix;
+  float quadDirWeights[2], quadDistWeights[2], quadBias;
+  // The ultra's pair weights as a dense [dir][headTag][modTag] array of
+  // (none, pair) weights:
+  std::vector<float> pairMatrix;
+};
+
+#endif // ARCFILTER_H
@@ -0,0 +1,194 @@
+/******************************************
+ *
+ * arcOutput.cpp
+ *
+ * Writing out each sentence's decisions, in the original text format
+ * or in one of the binary ones (see OutputFormat in arcFilter.h), all
+ * through a fixed buffer so that nothing is allocated per sentence.
+ *
+ ******************************************/
+
+#include "arcFilter.h"
+
+#include <stdint.h>   // For the binary fields
+#include <stdio.h>    // For snprintf
+#include <string.h>   // For memcpy
+#include <algorithm>  // For min
+
+// Gathers output in a fixed buffer, writing it to the stream in big
+// pieces rather than a string or a call per field:
+class OutputBuffer {
+ public:
+  OutputBuffer(std::ostream &o) : out(o), used(0) {}
+  ~OutputBuffer() { flush(); }
+
+  void put(char c) {
+	if (used == BUFSIZE) flush();
+	buf[used++] = c;
+  }
+
+  // An int, written out as fastInt2Str would:
+  void putInt(int d) {
+	char digits[12];
+	int len = 0;
+	unsigned int u = d;
+	if (d < 0) {
+	  put('-');
+	  u = -u;
+	}
+	do {
+	  digits[len++] = '0' + u % 10;
+	  u /= 10;
+	} while (u);
+	while (len) put(digits[--len]);
+  }
+
+  // A float, written out as ostream's default does:
+  void putFloat(float x) {
+	char digits[32];
+	putBytes(digits, snprintf(digits, sizeof(digits), "%g", x));
+  }
+
+  void putBytes(const void *bytes, int n) {
+	const char *p = (const char *)bytes;
+	while (n > 0) {
+	  if (used == BUFSIZE) flush();
+	  int chunk = std::min(n, BUFSIZE - used);
+	  memcpy(buf + used, p, chunk);
+	  used += chunk; p += chunk; n -= chunk;
+	}
+  }
+
+  void putUint32(uint32_t x) { putBytes(&x, sizeof(x)); }
+
+  void flush() {
+	if (used > 0) out.write(buf, used);
+	used = 0;
+  }
+
+ private:
+  static const int BUFSIZE = 8192;
+  std::ostream &out;
+  char buf[BUFSIZE];
+  int used;
+};
+
+// Write one sentence's decisions in the given format:
+void ArcFilter::writeHeads(std::ostream &out, const Sentence &sent, const HeadLists &heads,
+						   OutputFormat format, const HeadScoreLists *scores) const {
+  if (!fits(sent))
+	std::cerr << "Error: exceeding maximum sentence size\n" << std::endl;
+  {
+	OutputBuffer buf(out);
+	if (format == CSR_OUTPUT)
+	  writeCsr(buf, sent, heads, scores);
+	else if (format == BITS_OUTPUT)
+	  writeBits(buf, sent, heads, scores);
+	else
+	  writeText(buf, sent, heads, scores);
+  }
+  // As the original std::endl did:
+  out.flush();
+}
+
+// The original text format:
+void ArcFilter::writeText(OutputBuffer &buf, const Sentence &sent, const HeadLists &heads,
+						  const HeadScoreLists *scores) const {
+  if (!fits(sent)) {
+	// For now, just don't produce any output and move to next one:
+	buf.put('\n'); buf.put('\n');
+	return;
+  }
+  int sentSize = sent.tags.size();
+  if (filterType == RULE_FILTER) {
+	// The rules label each mod, and skip any without heads:
+	bool first = true;
+	for (int mod = 1; mod < sentSize; mod++) {
+	  const HeadList &headList = heads[mod];
+	  if (!headList.empty()) {
+		if (!first) buf.put('\t');
+		first = false;
+		buf.putInt(mod); buf.put(':'); buf.putInt(headList[0]);
+		for (int i=1; i<(int)(headList.size()); i++) {
+		  buf.put(','); buf.putInt(headList[i]);
+		}
+	  }
+	}
+  } else {
+	// The others give one (possibly empty) field per mod, with each
+	// head's score after it if there are scores:
+	for (int mod = 1; mod < sentSize; mod++) {
+	  const HeadList &headList = heads[mod];
+	  if (mod > 1) buf.put('\t');
+	  for (int i=0; i<(int)(headList.size()); i++) {
+		if (i > 0) buf.put(',');
+		buf.putInt(headList[i]);
+		if (scores != NULL) {
+		  buf.put(':'); buf.putFloat((*scores)[mod][i]);
+		}
+	  }
+	}
+  }
+  buf.put('\n');
+}
+
+// The heads' scores, in the same order as the heads, for the binary formats:
+static void putScores(OutputBuffer &buf, uint32_t sentSize, const HeadScoreLists &scores) {
+  for (uint32_t mod = 1; mod < sentSize; mod++) {
+	const HeadScores &headScores = scores[mod];
+	if (!headScores.empty())
+	  buf.putBytes(&headScores[0], sizeof(float) * headScores.size());
+  }
+}
+
+// The CSR format: the token count, the offsets and the heads:
+void ArcFilter::writeCsr(OutputBuffer &buf, const Sentence &sent, const HeadLists &heads,
+						 const HeadScoreLists *scores) const {
+  uint32_t sentSize = fits(sent) ? sent.tags.size() : 0;
+  uint32_t numHeads = 0;
+  for (uint32_t mod = 1; mod < sentSize; mod++)
+	numHeads += heads[mod].size();
+  buf.putUint32(sizeof(uint32_t) * (sentSize + 2) + sizeof(uint16_t) * numHeads +
+				(scores != NULL ? sizeof(float) * numHeads : 0));
+  buf.putUint32(sentSize);
+  uint32_t offset = 0;
+  buf.putUint32(offset);
+  for (uint32_t mod = 0; mod < sentSize; mod++) {
+	if (mod > 0) offset += heads[mod].size();
+	buf.putUint32(offset);
+  }
+  for (uint32_t mod = 1; mod < sentSize; mod++) {
+	const HeadList &headList = heads[mod];
+	for (int i=0; i<(int)(headList.size()); i++) {
+	  uint16_t head = headList[i];
+	  buf.putBytes(&head, sizeof(head));
+	}
+  }
+  if (scores != NULL)
+	putScores(buf, sentSize, *scores);
+}
+
+// The bit-matrix format: the token count, then a row of bits per mod:
+void ArcFilter::writeBits(OutputBuffer &buf, const Sentence &sent, const HeadLists &heads,
+						  const HeadScoreLists *scores) const {
+  uint32_t sentSize = fits(sent) ? sent.tags.size() : 0;
+  uint32_t numWords = (sentSize + 63) / 64;
+  uint32_t numHeads = 0;
+  if (scores != NULL)
+	for (uint32_t mod = 1; mod < sentSize; mod++)
+	  numHeads += heads[mod].size();
+  buf.putUint32(sizeof(uint32_t) + sizeof(uint64_t) * sentSize * numWords + sizeof(float) * numHeads);
+  buf.putUint32(sentSize);
+  for (uint32_t mod = 0; mod < sentSize; mod++) {
+	const HeadList &headList = heads[mod];
+	int next = 0;  // The heads are in order, so take them word by word:
+	for (uint32_t w = 0; w < numWords; w++) {
+	  uint64_t bits = 0;
+	  for (; next < (int)(headList.size()) && (uint32_t)(headList[next] >> 6) == w; next++)
+		bits |= (uint64_t)1 << (headList[next] & 63);
+	  buf.putBytes(&bits, sizeof(bits));
+	}
+  }
+  if (scores != NULL)
+	putScores(buf, sentSize, *scores);
+}
@@ -0,0 +1,508 @@
+/******************************************
+ *
+ * arcServer.cpp
+ *
+ * Serving an ArcFilter over a Unix domain socket, so that the weights
+ * are loaded once rather than by every job.  A client connects, writes
+ * word_tag_head lines, and shuts down its side of the connection when
+ * it's done; it gets back each sentence's decisions, in order and in
+ * the server's --format, as soon as they're ready, and the server
+ * closes the connection once they're all written.
+ *
+ * One thread reads every client.  The sentences it reads go onto the
+ * end of the last batch waiting for a worker, or into a new one, so an
+ * idle pool answers each sentence straight away and a busy one gets
+ * them in batches.  With too many batches in flight it stops reading,
+ * and the clients block on their writes until the workers catch up.
+ *
+ * SIGHUP reloads the weights from the same files, on a thread of its
+ * own, while the workers carry on with the old ones.  Once the new
+ * filter is loaded, it's swapped in for the batches that come after;
+ * the ones already being filtered finish on the old filter, which is
+ * freed when the last of them is done.  Replace the weight files by
+ * renaming the new ones over them: a compiled model is mapped straight
+ * from its file, so one written over in place changes under the old
+ * filter.
+ *
+ ******************************************/
+
+#include "arcFilter.h"
+
+#include <pthread.h>    // For the worker pool
+#include <poll.h>       // For waiting on the clients
+#include <signal.h>     // For stopping on SIGINT or SIGTERM, reloading on SIGHUP
+#include <errno.h>      // For EINTR
+#include <unistd.h>     // For read, close, unlink
+#include <string.h>     // For memchr, memset, strlen
+#include <sys/socket.h> // For the socket
+#include <sys/stat.h>   // For checking what's at the socket's path
+#include <sys/time.h>   // For the send timeout
+#include <sys/un.h>     // For sockaddr_un
+#include <sstream>      // For each sentence's output
+#include <deque>        // For the work queue
+#include <map>          // For each client's reorder buffer
+#include <algorithm>    // For min
+
+const int SERVERBATCHLINES = 64;  // Sentences handed to a worker at a time, at most
+const int SERVERBATCHESPERTHREAD = 4;  // Batches in flight per worker, at most
+const int READSIZE = 1 << 16;     // Bytes read from a client at a time
+const int SENDTIMEOUT = 30;       // Seconds a client can leave its answers unread
+const int RELOADWAIT = 100;       // Milliseconds between checks for a reload to finish
+
+// Set by SIGINT and SIGTERM:
+static volatile sig_atomic_t stopServing = 0;
+// Set by SIGHUP, until the reload starts:
+static volatile sig_atomic_t reloadWanted = 0;
+
+static void onStopSignal(int) {
+  stopServing = 1;
+}
+
+static void onReloadSignal(int) {
+  reloadWanted = 1;
+}
+
+// One answer, waiting for the ones before it to be written:
+struct ServerAnswer {
+  std::string text;
+  uint64_t arrivalNs;   // When its sentence was read
+};
+
+// One client.  The reader owns input; the rest is shared under lock:
+struct ServerClient {
+  int fd;
+  std::string input;    // Read, but not yet a whole line
+
+  pthread_mutex_t lock;
+  long numRead;         // Sentences read
+  long numWritten;      // Answers written back
+  bool inputDone;       // Nothing more will be read
+  bool failed;          // Writing to it failed, so drop its answers
+  bool closed;
+  std::map<long, ServerAnswer> finished;  // Filtered, waiting for their turn
+};
+
+// One sentence, as read:
+struct ServerRequest {
+  ServerClient *client;
+  long seq;
+  std::string line;     // Ending in '\n'
+  uint64_t arrivalNs;
+};
+
+typedef std::vector<ServerRequest> ServerBatch;
+
+// One loaded filter, and the batches it's filtering:
+struct ServedModel {
+  ArcFilter *filter;
+  bool owned;   // Loaded by a reload, rather than the one serve was called on
+  int users;    // Batches being filtered with it
+};
+
+// What the reader, the workers and the reloads share:
+struct ServerState {
+  ServedModel *model;  // The filter new batches get; only a reload changes it
+  const FilterOptions *opts;
+
+  pthread_mutex_t lock;
+  pthread_cond_t workReady;  // Signalled when a batch is queued, or serving stops
+  pthread_cond_t roomReady;  // Signalled when a batch is done
+
+  std::deque<ServerBatch *> work;  // Batches waiting for a worker
+  bool stopping;
+  int inFlight;        // Batches queued or being filtered
+  int maxInFlight;
+
+  FilterStats *stats;  // Everyone's stats so far, if they're being kept
+  uint64_t lastSave;   // When they were last written out
+
+  bool loading;        // A reload is running
+};
+
+// Let go of a model.  Call with the state's lock held; if it was the
+// last user of a model that's been replaced, the model is returned, to
+// be freed after unlocking:
+static ServedModel *dropModel(ServerState &s, ServedModel *m) {
+  if (--m->users > 0 || m == s.model) return NULL;
+  return m;
+}
+
+static void freeModel(ServedModel *m) {
+  if (m == NULL) return;
+  if (m->owned)
+    delete m->filter;
+  else
+    m->filter->releaseWeights();
+  delete m;
+  std::cerr << "Freed the old weights" << std::endl;
+}
+
+// The reload thread: load the filter again, then swap it in:
+static void *reloadModel(void *arg) {
+  ServerState &s = *(ServerState *)arg;
+  uint64_t start = statsClock();
+  // Only this thread changes s.model, so it can be read unlocked:
+  ArcFilter *filter = s.model->filter->reload();
+  ServedModel *retired = NULL;
+  pthread_mutex_lock(&s.lock);
+  if (filter != NULL) {
+    ServedModel *m = new ServedModel;
+    m->filter = filter;
+    m->owned = true;
+    m->users = 0;
+    ServedModel *old = s.model;
+    s.model = m;
+    if (old->users == 0)
+      retired = old;
+  }
+  s.loading = false;
+  pthread_mutex_unlock(&s.lock);
+  if (filter != NULL)
+    std::cerr << "Reloaded the weights in " << (statsClock() - start) / 1000000 << "ms" << std::endl;
+  freeModel(retired);
+  return NULL;
+}
+
+// Write all of text to the client, or return false:
+static bool sendAll(int fd, const std::string &text) {
+  const char *p = text.data();
+  size_t left = text.size();
+  while (left > 0) {
+    ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    left -= n;
+  }
+  return true;
+}
+
+static void closeClient(ServerClient *c) {
+  close(c->fd);
+  pthread_mutex_destroy(&c->lock);
+  delete c;
+}
+
+// Is the client done with, now?  Call with its lock held; only the
+// first caller to see it gets true, and must close it:
+static bool finishedWith(ServerClient *c) {
+  if (c->closed || !c->inputDone || c->numWritten != c->numRead) return false;
+  c->closed = true;
+  return true;
+}
+
+// Hand back one answer, writing out whatever answers the client now
+// has next in line, and closing it if that's all of them:
+static void answer(const ServerRequest &r, const std::string &text, FilterStats *stats) {
+  ServerClient *c = r.client;
+  pthread_mutex_lock(&c->lock);
+  ServerAnswer &a = c->finished[r.seq];
+  a.text = text;
+  a.arrivalNs = r.arrivalNs;
+
+  std::string ready;
+  std::vector<uint64_t> arrivals;
+  std::map<long, ServerAnswer>::iterator next;
+  while ((next = c->finished.find(c->numWritten)) != c->finished.end()) {
+    ready += next->second.text;
+    arrivals.push_back(next->second.arrivalNs);
+    c->finished.erase(next);
+    c->numWritten++;
+  }
+  if (!ready.empty() && !c->failed && !sendAll(c->fd, ready)) {
+    // Let the reader see it's gone:
+    c->failed = true;
+    shutdown(c->fd, SHUT_RDWR);
+  }
+  if (stats != NULL) {
+    uint64_t now = statsClock();
+    for (size_t i=0; i<arrivals.size(); i++)
+      stats->addRequestLatency(now - arrivals[i]);
+  }
+  bool done = finishedWith(c);
+  pthread_mutex_unlock(&c->lock);
+  if (done)
+    closeClient(c);
+}
+
+// Each worker: take a batch, filter it, and answer each sentence:
+static void *serverWorker(void *arg) {
+  ServerState &s = *(ServerState *)arg;
+  const FilterOptions &opts = *s.opts;
+  Sentence sent;
+  HeadLists heads;
+  HeadScoreLists scores;
+  FilterStats batchStats;
+  std::ostringstream out;
+  for (;;) {
+    pthread_mutex_lock(&s.lock);
+    while (s.work.empty() && !s.stopping)
+      pthread_cond_wait(&s.workReady, &s.lock);
+    if (s.work.empty()) {
+      pthread_mutex_unlock(&s.lock);
+      return NULL;
+    }
+    ServerBatch *batch = s.work.front();
+    s.work.pop_front();
+    ServedModel *model = s.model;
+    model->users++;
+    pthread_mutex_unlock(&s.lock);
+
+    batchStats.clear();
+    for (size_t i=0; i<batch->size(); i++) {
+      ServerRequest &r = (*batch)[i];
+      out.str("");
+      model->filter->filterLine(&r.line[0], r.line.size() - 1, sent, heads, &out, opts.format,
+                           s.stats != NULL ? &batchStats : NULL, opts.withScores ? &scores : NULL);
+      answer(r, out.str(), s.stats != NULL ? &batchStats : NULL);
+    }
+    delete batch;
+
+    pthread_mutex_lock(&s.lock);
+    s.inFlight--;
+    pthread_cond_signal(&s.roomReady);
+    if (s.stats != NULL) {
+      s.stats->add(batchStats);
+      s.stats->saveEvery(opts.statsFile, opts.statsInterval, s.lastSave);
+    }
+    ServedModel *retired = dropModel(s, model);
+    pthread_mutex_unlock(&s.lock);
+    freeModel(retired);
+  }
+}
+
+// Take the whole lines out of what's been read from a client (and, at
+// the end of its input, any last line without a '\n'):
+static void takeLines(ServerClient *c, bool atEnd, std::vector<ServerRequest> &fresh) {
+  uint64_t now = statsClock();
+  size_t start = 0;
+  pthread_mutex_lock(&c->lock);
+  for (;;) {
+    const char *newline = (const char *)memchr(c->input.data() + start, '\n', c->input.size() - start);
+    size_t end = (newline != NULL) ? newline - c->input.data() : c->input.size();
+    if (newline == NULL && (!atEnd || start == end)) break;
+    ServerRequest r;
+    r.client = c;
+    r.seq = c->numRead++;
+    r.line.assign(c->input, start, end - start);
+    r.line += '\n';
+    r.arrivalNs = now;
+    fresh.push_back(r);
+    start = end + 1;
+    if (newline == NULL) break;
+  }
+  c->input.erase(0, std::min(start, c->input.size()));
+  // Once its input is done, a worker may close it as soon as it's
+  // unlocked:
+  if (atEnd)
+    c->inputDone = true;
+  bool done = finishedWith(c);
+  pthread_mutex_unlock(&c->lock);
+  if (done)
+    closeClient(c);
+}
+
+// Put the sentences just read onto the last batch still waiting, while
+// it has room, then into new ones:
+static void queueRequests(ServerState &s, std::vector<ServerRequest> &fresh) {
+  if (fresh.empty()) return;
+  pthread_mutex_lock(&s.lock);
+  for (size_t i=0; i<fresh.size(); i++) {
+    if (s.work.empty() || (int)s.work.back()->size() >= SERVERBATCHLINES) {
+      s.work.push_back(new ServerBatch);
+      s.inFlight++;
+    }
+    s.work.back()->push_back(fresh[i]);
+  }
+  pthread_cond_broadcast(&s.workReady);
+  pthread_mutex_unlock(&s.lock);
+  fresh.clear();
+}
+
+// Listen on path, taking the place of any socket left there before:
+static int listenOn(const char *path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    std::cerr << "Error! Socket path " << path << " is too long" << std::endl;
+    exit(-1);
+  }
+  strcpy(addr.sun_path, path);
+  struct stat st;
+  if (lstat(path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      std::cerr << "Error! " << path << " exists and isn't a socket" << std::endl;
+      exit(-1);
+    }
+    unlink(path);
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+    std::cerr << "Error! Could not listen on socket " << path << std::endl;
+    exit(-1);
+  }
+  return fd;
+}
+
+void ArcFilter::serve(const FilterOptions &opts) {
+  if (opts.withScores && !hasScores()) {
+    std::cerr << "Error! This filter has no scores to write" << std::endl;
+    exit(-1);
+  }
+  int listenFd = listenOn(opts.socketPath);
+
+  ServerState s;
+  s.model = new ServedModel;
+  s.model->filter = this;
+  s.model->owned = false;
+  s.model->users = 0;
+  s.opts = &opts;
+  FilterStats stats;
+  s.stats = (opts.statsFile != NULL) ? &stats : NULL;
+  s.lastSave = statsClock();
+  pthread_mutex_init(&s.lock, NULL);
+  pthread_cond_init(&s.workReady, NULL);
+  pthread_cond_init(&s.roomReady, NULL);
+  s.stopping = false;
+  s.inFlight = 0;
+  s.maxInFlight = SERVERBATCHESPERTHREAD * opts.numThreads;
+  s.loading = false;
+
+  // Only this thread takes the signals, so that they interrupt its poll:
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = onStopSignal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  action.sa_handler = onReloadSignal;
+  sigaction(SIGHUP, &action, NULL);
+  sigset_t serverSignals;
+  sigemptyset(&serverSignals);
+  sigaddset(&serverSignals, SIGINT);
+  sigaddset(&serverSignals, SIGTERM);
+  sigaddset(&serverSignals, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &serverSignals, NULL);
+
+  std::vector<pthread_t> workers(opts.numThreads);
+  for (int t=0; t<opts.numThreads; t++) {
+    if (pthread_create(&workers[t], NULL, serverWorker, &s) != 0) {
+      std::cerr << "Error! Could not start worker thread " << t << std::endl;
+      exit(-1);
+    }
+  }
+  pthread_sigmask(SIG_UNBLOCK, &serverSignals, NULL);
+  std::cerr << "Serving on " << opts.socketPath << " with " << opts.numThreads << " workers" << std::endl;
+
+  // This thread reads every client:
+  std::vector<ServerClient *> clients;
+  std::vector<struct pollfd> fds;
+  std::vector<ServerRequest> fresh;
+  std::vector<char> buf(READSIZE);
+  pthread_t loader;
+  bool loaderStarted = false;
+  while (!stopServing) {
+    // Don't run too far ahead of the workers:
+    pthread_mutex_lock(&s.lock);
+    while (s.inFlight >= s.maxInFlight)
+      pthread_cond_wait(&s.roomReady, &s.lock);
+    // Start any reload that's wanted, once the last one is done:
+    bool startReload = reloadWanted && !s.loading;
+    if (startReload)
+      s.loading = true;
+    pthread_mutex_unlock(&s.lock);
+    if (startReload) {
+      reloadWanted = 0;
+      if (loaderStarted)
+        pthread_join(loader, NULL);
+      std::cerr << "Reloading the weights" << std::endl;
+      pthread_sigmask(SIG_BLOCK, &serverSignals, NULL);
+      loaderStarted = (pthread_create(&loader, NULL, reloadModel, &s) == 0);
+      pthread_sigmask(SIG_UNBLOCK, &serverSignals, NULL);
+      if (!loaderStarted) {
+        std::cerr << "Error! Could not start the reload thread" << std::endl;
+        pthread_mutex_lock(&s.lock);
+        s.loading = false;
+        pthread_mutex_unlock(&s.lock);
+      }
+    }
+
+    fds.resize(clients.size() + 1);
+    fds[0].fd = listenFd;
+    fds[0].events = POLLIN;
+    for (size_t i=0; i<clients.size(); i++) {
+      fds[i+1].fd = clients[i]->fd;
+      fds[i+1].events = POLLIN;
+    }
+    // With a reload still to start, come back for it:
+    if (poll(&fds[0], fds.size(), reloadWanted ? RELOADWAIT : -1) < 0) {
+      if (errno == EINTR) continue;
+      std::cerr << "Error! Could not wait for clients" << std::endl;
+      exit(-1);
+    }
+
+    // Read what each client has for us, dropping the ones that are done:
+    size_t kept = 0;
+    for (size_t i=0; i<clients.size(); i++) {
+      ServerClient *c = clients[i];
+      if (fds[i+1].revents != 0) {
+        ssize_t n = read(c->fd, &buf[0], buf.size());
+        if (n < 0 && errno == EINTR) {
+          clients[kept++] = c;
+          continue;
+        }
+        if (n > 0)
+          c->input.append(&buf[0], n);
+        takeLines(c, n <= 0, fresh);
+        if (n <= 0) continue;  // It's done, and may be closed already
+      }
+      clients[kept++] = c;
+    }
+    clients.resize(kept);
+    queueRequests(s, fresh);
+
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(listenFd, NULL, NULL);
+      if (fd >= 0) {
+        struct timeval timeout = { SENDTIMEOUT, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        ServerClient *c = new ServerClient;
+        c->fd = fd;
+        pthread_mutex_init(&c->lock, NULL);
+        c->numRead = c->numWritten = 0;
+        c->inputDone = c->failed = c->closed = false;
+        clients.push_back(c);
+        if (s.stats != NULL) {
+          pthread_mutex_lock(&s.lock);
+          s.stats->connections++;
+          pthread_mutex_unlock(&s.lock);
+        }
+      }
+    }
+  }
+
+  // Stop: answer everything read so far, then shut down:
+  std::cerr << "Stopping" << std::endl;
+  close(listenFd);
+  unlink(opts.socketPath);
+  for (size_t i=0; i<clients.size(); i++)
+    takeLines(clients[i], true, fresh);
+  queueRequests(s, fresh);
+  pthread_mutex_lock(&s.lock);
+  s.stopping = true;
+  pthread_cond_broadcast(&s.workReady);
+  pthread_mutex_unlock(&s.lock);
+  for (int t=0; t<opts.numThreads; t++)
+    pthread_join(workers[t], NULL);
+  if (loaderStarted)
+    pthread_join(loader, NULL);
+  if (s.stats != NULL)
+    s.stats->save(opts.statsFile);
+  if (s.model->owned)
+    delete s.model->filter;
+  delete s.model;
+
+  pthread_cond_destroy(&s.roomReady);
+  pthread_cond_destroy(&s.workReady);
+  pthread_mutex_destroy(&s.lock);
+}
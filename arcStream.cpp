@@ -0,0 +1,245 @@
+/******************************************
+ *
+ * arcStream.cpp
+ *
+ * Driving an ArcFilter over a stream of input lines, on one thread or
+ * on a pool of them, plus the command-line options for doing so.
+ *
+ ******************************************/
+
+#include "arcFilter.h"
+#include "lineReader.h"
+
+#include <pthread.h>  // For the worker pool
+#include <string.h>   // For strcmp, memchr
+#include <sstream>    // For each batch's output
+#include <deque>      // For the work queue
+#include <map>        // For the reorder buffer
+
+const int BATCHLINES = 64;   // Input lines handed to a worker at a time
+const int BATCHESPERTHREAD = 4;  // Batches in flight per worker, at most
+
+// Take any options out of argv:
+bool parseFilterOptions(int &nargin, char **argv, FilterOptions &opts) {
+  int kept = 1;
+  for (int i=1; i<nargin; i++) {
+    if (strcmp(argv[i], "--threads") == 0) {
+      if (i+1 >= nargin) return false;
+      opts.numThreads = atoi(argv[++i]);
+      if (opts.numThreads < 1) return false;
+    } else if (strcmp(argv[i], "--format") == 0) {
+      if (i+1 >= nargin) return false;
+      i++;
+      if (strcmp(argv[i], "text") == 0) opts.format = TEXT_OUTPUT;
+      else if (strcmp(argv[i], "csr") == 0) opts.format = CSR_OUTPUT;
+      else if (strcmp(argv[i], "bits") == 0) opts.format = BITS_OUTPUT;
+      else return false;
+    } else if (strcmp(argv[i], "--scores") == 0) {
+      opts.withScores = true;
+    } else if (strcmp(argv[i], "--top-k") == 0) {
+      if (i+1 >= nargin) return false;
+      opts.headLimits.topK = atoi(argv[++i]);
+      if (opts.headLimits.topK < 1) return false;
+    } else if (strcmp(argv[i], "--head-margin") == 0) {
+      if (i+1 >= nargin) return false;
+      opts.headLimits.margin = atof(argv[++i]);
+      if (opts.headLimits.margin < 0) return false;
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      if (i+1 >= nargin) return false;
+      opts.statsFile = argv[++i];
+    } else if (strcmp(argv[i], "--serve") == 0) {
+      if (i+1 >= nargin) return false;
+      opts.socketPath = argv[++i];
+    } else if (strcmp(argv[i], "--stats-interval") == 0) {
+      if (i+1 >= nargin) return false;
+      opts.statsInterval = atof(argv[++i]);
+      if (opts.statsInterval <= 0) return false;
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      return false;
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  nargin = kept;
+  argv[nargin] = NULL;
+  return true;
+}
+
+// One batch of input lines, each ending in '\n', and, once it's
+// filtered, its output:
+struct StreamBatch {
+  long seq;
+  std::string text;
+  std::string output;
+};
+
+// What the reader, the workers and the output share:
+struct StreamPipeline {
+  const ArcFilter *filter;
+  std::ostream *out;
+  OutputFormat format;
+  const FilterOptions *opts;
+
+  pthread_mutex_t lock;
+  pthread_cond_t workReady;  // Signalled when a batch is queued, or input ends
+  pthread_cond_t roomReady;  // Signalled when a batch has been written out
+
+  std::deque<StreamBatch *> work;  // Batches waiting for a worker
+  bool inputDone;
+  int inFlight;     // Batches read but not yet written out
+  int maxInFlight;
+
+  std::map<long, StreamBatch *> finished;  // Filtered, waiting for their turn
+  long nextOut;     // The next batch to write
+
+  FilterStats *stats;  // Everyone's stats so far, if they're being kept
+  uint64_t lastSave;   // When they were last written out
+};
+
+// Each worker: take a batch, filter it, then write out whatever batches
+// are now next in line:
+static void *streamWorker(void *arg) {
+  StreamPipeline &p = *(StreamPipeline *)arg;
+  Sentence sent;
+  HeadLists heads;
+  FilterStats batchStats;
+  HeadScoreLists scores;
+  for (;;) {
+    pthread_mutex_lock(&p.lock);
+    while (p.work.empty() && !p.inputDone)
+      pthread_cond_wait(&p.workReady, &p.lock);
+    if (p.work.empty()) {
+      pthread_mutex_unlock(&p.lock);
+      return NULL;
+    }
+    StreamBatch *batch = p.work.front();
+    p.work.pop_front();
+    pthread_mutex_unlock(&p.lock);
+
+    std::ostringstream batchOut;
+    batchStats.clear();
+    char *line = &batch->text[0];
+    char *end = line + batch->text.size();
+    while (line < end) {
+      char *newline = (char *)memchr(line, '\n', end - line);
+      p.filter->filterLine(line, newline - line, sent, heads, p.out != NULL ? &batchOut : NULL, p.format,
+                     p.stats != NULL ? &batchStats : NULL, p.opts->withScores ? &scores : NULL);
+      line = newline + 1;
+    }
+    if (p.out != NULL)
+      batch->output = batchOut.str();
+
+    // The reorder buffer:
+    pthread_mutex_lock(&p.lock);
+    if (p.stats != NULL) {
+      p.stats->add(batchStats);
+      p.stats->saveEvery(p.opts->statsFile, p.opts->statsInterval, p.lastSave);
+    }
+    p.finished[batch->seq] = batch;
+    std::map<long, StreamBatch *>::iterator next;
+    while ((next = p.finished.find(p.nextOut)) != p.finished.end()) {
+      if (p.out != NULL)
+        *p.out << next->second->output;
+      delete next->second;
+      p.finished.erase(next);
+      p.nextOut++;
+      p.inFlight--;
+      pthread_cond_signal(&p.roomReady);
+    }
+    pthread_mutex_unlock(&p.lock);
+  }
+}
+
+// Read word_tag_head lines from in, write decisions to out:
+void ArcFilter::filterStream(std::istream &in, std::ostream *out, const FilterOptions &opts) const {
+  if (opts.withScores && !hasScores()) {
+    std::cerr << "Error! This filter has no scores to write" << std::endl;
+    exit(-1);
+  }
+  if (opts.numThreads <= 1) {
+    LineReader reader(in);
+    char *line;
+    int len;
+    Sentence sent;
+    HeadLists heads;
+    FilterStats stats;
+    HeadScoreLists scores;
+    uint64_t lastSave = statsClock();
+    while (reader.nextLine(line, len)) {
+      filterLine(line, len, sent, heads, out, opts.format, opts.statsFile != NULL ? &stats : NULL,
+                 opts.withScores ? &scores : NULL);
+      if (opts.statsFile != NULL)
+        stats.saveEvery(opts.statsFile, opts.statsInterval, lastSave);
+    }
+    if (opts.statsFile != NULL)
+      stats.save(opts.statsFile);
+    return;
+  }
+
+  StreamPipeline p;
+  p.filter = this;
+  p.out = out;
+  p.format = opts.format;
+  p.opts = &opts;
+  FilterStats stats;
+  p.stats = (opts.statsFile != NULL) ? &stats : NULL;
+  p.lastSave = statsClock();
+  pthread_mutex_init(&p.lock, NULL);
+  pthread_cond_init(&p.workReady, NULL);
+  pthread_cond_init(&p.roomReady, NULL);
+  p.inputDone = false;
+  p.inFlight = 0;
+  p.maxInFlight = BATCHESPERTHREAD * opts.numThreads;
+  p.nextOut = 0;
+
+  std::vector<pthread_t> workers(opts.numThreads);
+  for (int t=0; t<opts.numThreads; t++) {
+    if (pthread_create(&workers[t], NULL, streamWorker, &p) != 0) {
+      std::cerr << "Error! Could not start worker thread " << t << std::endl;
+      exit(-1);
+    }
+  }
+
+  // This thread is the reader:
+  LineReader reader(in);
+  long seq = 0;
+  bool more = true;
+  while (more) {
+    StreamBatch *batch = new StreamBatch;
+    batch->seq = seq++;
+    char *line;
+    int len;
+    int numLines = 0;
+    while (numLines < BATCHLINES && (more = reader.nextLine(line, len))) {
+      batch->text.append(line, len);
+      batch->text += '\n';
+      numLines++;
+    }
+    if (numLines == 0) {
+      delete batch;
+      break;
+    }
+    pthread_mutex_lock(&p.lock);
+    // Don't run too far ahead of the output:
+    while (p.inFlight >= p.maxInFlight)
+      pthread_cond_wait(&p.roomReady, &p.lock);
+    p.inFlight++;
+    p.work.push_back(batch);
+    pthread_cond_signal(&p.workReady);
+    pthread_mutex_unlock(&p.lock);
+  }
+
+  pthread_mutex_lock(&p.lock);
+  p.inputDone = true;
+  pthread_cond_broadcast(&p.workReady);
+  pthread_mutex_unlock(&p.lock);
+
+  for (int t=0; t<opts.numThreads; t++)
+    pthread_join(workers[t], NULL);
+  if (p.stats != NULL)
+    p.stats->save(opts.statsFile);
+
+  pthread_cond_destroy(&p.roomReady);
+  pthread_cond_destroy(&p.workReady);
+  pthread_mutex_destroy(&p.lock);
+}
@@ -0,0 +1,154 @@
+/******************************************
+ * 
+ * benchFilters.cpp
+ *
+ * Throughput of every filter on synthetic corpora: sentences are cut
+ * from the corpus token stream at random, either with the corpus's own
+ * length distribution or at fixed lengths doubling up to the longest
+ * the filters take, and each filter is run over them from memory
+ * (without writing out the decisions, which would otherwise dominate).
+ * One tab-separated row per filter and length bucket, so runs can be
+ * compared across commits.
+ *
+ ******************************************/
+
+#include <iostream>   // For reading/writing STDIN
+#include <fstream>    // For the corpus
+#include <sstream>    // For in-memory input
+#include <sys/time.h> // For wall-clock timing
+
+#include "arcFilter.h"
+
+const std::string USAGE = "USAGE: ./benchFilters linearWeights quadWeights ultraPairWeights taggedFile [tokensPerBucket] [arcsPerBucket] [seed]";
+
+const int REPEATS = 3;  // Each bucket is timed this often, keeping the fastest
+
+// Wall-clock seconds:
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// One length bucket's corpus:
+struct BenchBucket {
+  std::string name;
+  std::string text;
+  long sentences;
+  long tokens;  // Not counting the roots
+  double arcs;  // Head-mod pairs a filter has to decide on
+};
+
+// Append a sentence of length tokens, cut from a random place in the
+// corpus, to the bucket:
+static void addSentence(BenchBucket &bucket, const StrVec &tokens, int length) {
+  long start = rand() % tokens.size();
+  bucket.text += "ROOT_ROOT_-1";
+  for (int t=0; t<length; t++)
+	bucket.text += " " + tokens[(start + t) % tokens.size()];
+  bucket.text += "\n";
+  bucket.sentences++;
+  bucket.tokens += length;
+  bucket.arcs += (double)length * length;
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+// Run program
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+int main(int nargin, char** argv) {
+  if (nargin < 5 || nargin > 8) {
+    std::cerr << USAGE << std::endl;
+	exit(-1);
+  }
+  long tokensPerBucket = (nargin > 5) ? atol(argv[5]) : 20000;
+  double arcsPerBucket = (nargin > 6) ? atof(argv[6]) : 2e6;
+  srand((nargin > 7) ? atoi(argv[7]) : 1);
+
+  ////////////////////////////////////////////////
+  // Read the corpus tokens into memory, less each sentence's root, and
+  // with the heads dropped (they'd be meaningless in new sentences):
+  ////////////////////////////////////////////////
+  std::ifstream file(argv[4]);
+  if (!file) {
+    std::cerr << "Error! Corpus " << argv[4] << " can not be opened" << std::endl;
+	exit(-1);
+  }
+  StrVec tokens;
+  std::vector<int> lengths;
+  std::string input;
+  while (getline(file, input, '\n')) {
+	std::istringstream line(input);
+	std::string token;
+	int length = 0;
+	while (line >> token) {
+	  if (token.compare(0, 5, "ROOT_") == 0) continue;
+	  tokens.push_back(token.substr(0, token.rfind('_')) + "_*");
+	  length++;
+	}
+	if (length > 0 && length < MAXSENTSIZE) lengths.push_back(length);
+  }
+  if (tokens.empty()) {
+    std::cerr << "Error! No tokens in " << argv[4] << std::endl;
+	exit(-1);
+  }
+
+  ////////////////////////////////////////////////
+  // Build the buckets: first the corpus's own lengths, then fixed
+  // lengths for the scaling curves.  Long sentences are held to the
+  // arc budget, so the quadratic filters don't take all day:
+  ////////////////////////////////////////////////
+  std::vector<BenchBucket> buckets;
+  BenchBucket sampled;
+  sampled.name = "sampled";
+  sampled.sentences = 0; sampled.tokens = 0; sampled.arcs = 0;
+  while (sampled.tokens < tokensPerBucket)
+	addSentence(sampled, tokens, lengths[rand() % lengths.size()]);
+  buckets.push_back(sampled);
+
+  int fixedLengths[] = { 5, 10, 20, 40, 80, 160, 320, 640, MAXSENTSIZE-1 };
+  for (int l=0; l<(int)(sizeof(fixedLengths) / sizeof(fixedLengths[0])); l++) {
+	int length = fixedLengths[l];
+	long sentences = (tokensPerBucket + length - 1) / length;
+	long arcSentences = (long)(arcsPerBucket / ((double)length * length)) + 1;
+	if (arcSentences < sentences) sentences = arcSentences;
+	BenchBucket bucket;
+	std::ostringstream name;
+	name << length;
+	bucket.name = name.str();
+	bucket.sentences = 0; bucket.tokens = 0; bucket.arcs = 0;
+	for (long s=0; s<sentences; s++)
+	  addSentence(bucket, tokens, length);
+	buckets.push_back(bucket);
+  }
+
+  ////////////////////////////////////////////////
+  // Filter every bucket with every filter:
+  ////////////////////////////////////////////////
+  const char *names[] = { "rule", "linear", "quad", "ultra" };
+  FilterType types[] = { RULE_FILTER, LINEAR_FILTER, QUAD_FILTER, ULTRA_FILTER };
+  const char *weightsB[] = { NULL, NULL, argv[2], argv[3] };
+
+  std::cout << "filter\tbucket\tsentences\ttokens\tarcs\tseconds\tsentences/sec\ttokens/sec\tns/arc" << std::endl;
+  for (int f=0; f<4; f++) {
+	ArcFilter filter(types[f], argv[1], weightsB[f]);
+	for (int b=0; b<(int)buckets.size(); b++) {
+	  const BenchBucket &bucket = buckets[b];
+	  double seconds = 0;
+	  for (int r=0; r<REPEATS; r++) {
+		std::istringstream in(bucket.text);
+		double start = now();
+		filter.filterStream(in, NULL);
+		double elapsed = now() - start;
+		if (r == 0 || elapsed < seconds) seconds = elapsed;
+	  }
+	  std::cout << names[f] << "\t" << bucket.name << "\t" << bucket.sentences << "\t"
+				<< bucket.tokens << "\t" << bucket.arcs << "\t" << seconds << "\t"
+				<< bucket.sentences / seconds << "\t" << bucket.tokens / seconds << "\t"
+				<< seconds * 1e9 / bucket.arcs << std::endl;
+	}
+  }
+
+  return 0;
+}
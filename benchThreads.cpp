@@ -0,0 +1,88 @@
+/******************************************
+ * 
+ * benchThreads.cpp
+ *
+ * Throughput of a filter against the number of worker threads: the
+ * corpus (repeated copies times) is filtered from memory to memory
+ * with 1, 2, 4, ... threads, and the wall-clock rate reported as
+ * tab-separated columns.
+ *
+ ******************************************/
+
+#include <iostream>   // For reading/writing STDIN
+#include <fstream>    // For the corpus
+#include <sstream>    // For in-memory input and output
+#include <string.h>   // For strcmp
+#include <sys/time.h> // For wall-clock timing
+
+#include "arcFilter.h"
+
+const std::string USAGE = "USAGE: ./benchThreads rule|linear|quad|ultra weightsA weightsB taggedFile [maxThreads] [copies]";
+
+// Wall-clock seconds:
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+// Run program
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+int main(int nargin, char** argv) {
+  if (nargin < 5 || nargin > 7) {
+    std::cerr << USAGE << std::endl;
+	exit(-1);
+  }
+  FilterType type;
+  if (strcmp(argv[1], "rule") == 0) type = RULE_FILTER;
+  else if (strcmp(argv[1], "linear") == 0) type = LINEAR_FILTER;
+  else if (strcmp(argv[1], "quad") == 0) type = QUAD_FILTER;
+  else if (strcmp(argv[1], "ultra") == 0) type = ULTRA_FILTER;
+  else {
+    std::cerr << USAGE << std::endl;
+	exit(-1);
+  }
+  int maxThreads = (nargin > 5) ? atoi(argv[5]) : 8;
+  int copies = (nargin > 6) ? atoi(argv[6]) : 1;
+
+  ArcFilter filter(type, argv[2], argv[3]);
+
+  ////////////////////////////////////////////////
+  // Read the corpus into memory:
+  ////////////////////////////////////////////////
+  std::ifstream file(argv[4]);
+  if (!file) {
+    std::cerr << "Error! Corpus " << argv[4] << " can not be opened" << std::endl;
+	exit(-1);
+  }
+  std::stringstream contents;
+  contents << file.rdbuf();
+  std::string corpus;
+  for (int c=0; c<copies; c++) corpus += contents.str();
+  long sentences = 0;
+  for (std::string::size_type i=0; i<corpus.size(); i++)
+	if (corpus[i] == '\n') sentences++;
+
+  ////////////////////////////////////////////////
+  // Filter it with more and more threads:
+  ////////////////////////////////////////////////
+  std::cout << "threads\tseconds\tsentences/sec\tspeedup" << std::endl;
+  double baseRate = 0;
+  for (int threads=1; threads<=maxThreads; threads*=2) {
+	FilterOptions opts;
+	opts.numThreads = threads;
+	std::istringstream in(corpus);
+	std::ostringstream out;
+	double start = now();
+	filter.filterStream(in, &out, opts);
+	double seconds = now() - start;
+	double rate = sentences / seconds;
+	if (threads == 1) baseRate = rate;
+	std::cout << threads << "\t" << seconds << "\t" << rate << "\t" << rate / baseRate << std::endl;
+  }
+
+  return 0;
+}
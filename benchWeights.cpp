@@ -0,0 +1,110 @@
+/******************************************
+ * 
+ * benchWeights.cpp
+ *
+ * Microbenchmark of the linear weight lookups: the feature IDs of a
+ * tagged corpus looked up in a tr1::unordered_map (the original
+ * LinearWeightsMap layout) versus the flat WeightTable.
+ *
+ ******************************************/
+
+#include <iostream>   // For reading/writing STDIN
+#include <fstream>    // For the corpus
+#include <time.h>     // For timing:
+
+#include "weightTable.h"
+
+const std::string USAGE = "USAGE: ./benchWeights linearWeights taggedFile [rounds]";
+
+// Seconds of CPU time since start:
+static double secondsSince(clock_t start) {
+  return ((double)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+// Run program
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+int main(int nargin, char** argv) {
+  if (nargin != 3 && nargin != 4) {
+    std::cerr << USAGE << std::endl;
+	exit(-1);
+  }
+  int rounds = (nargin == 4) ? atoi(argv[3]) : 20;
+
+  ////////////////////////////////////////////////
+  // Load the weights both ways:
+  ////////////////////////////////////////////////
+  LinearWeightsMap mapWeights;
+  initializeLinearWeights(argv[1], mapWeights);
+  WeightTable tableWeights;
+  tableWeights.build(mapWeights);
+
+  ////////////////////////////////////////////////
+  // Get every token's features, in the order the filters look them up:
+  ////////////////////////////////////////////////
+  std::ifstream corpus(argv[2]);
+  if (!corpus) {
+    std::cerr << "Error! Corpus " << argv[2] << " can not be opened" << std::endl;
+	exit(-1);
+  }
+  FeatureIds feats;
+  std::string input;
+  while (getline(corpus, input, '\n')) {
+	normLines(input);
+	StrVec words, tags;
+	readSentence(input, words, tags);
+	int sentSize = tags.size();
+	for (int i=1; i<sentSize; i++)
+	  buildLinearFeatureIds(i, words, tags, sentSize, feats);
+  }
+  if (feats.empty()) {
+    std::cerr << "Error! No tokens in " << argv[2] << std::endl;
+	exit(-1);
+  }
+
+  ////////////////////////////////////////////////
+  // Time the lookups, summing the rows as the filters do:
+  ////////////////////////////////////////////////
+  float mapSum = 0, tableSum = 0;
+  long hits = 0;
+
+  clock_t startTime = clock();
+  for (int r=0; r<rounds; r++) {
+	for (FeatureIds::const_iterator itr=feats.begin(); itr != feats.end(); itr++) {
+	  LinearWeightsMap::const_iterator finder = mapWeights.find(*itr);
+	  if (finder != mapWeights.end())
+		for (int i=0; i<8; i++) mapSum += finder->second[i];
+	}
+  }
+  double mapTime = secondsSince(startTime);
+
+  startTime = clock();
+  for (int r=0; r<rounds; r++) {
+	for (FeatureIds::const_iterator itr=feats.begin(); itr != feats.end(); itr++) {
+	  const float *finder = tableWeights.find(*itr);
+	  if (finder != NULL) {
+		hits++;
+		for (int i=0; i<8; i++) tableSum += finder[i];
+	  }
+	}
+  }
+  double tableTime = secondsSince(startTime);
+
+  if (mapSum != tableSum) {
+    std::cerr << "Error! The two tables gave different sums" << std::endl;
+	exit(-1);
+  }
+
+  ////////////////////////////////////////////////
+  // Report:
+  ////////////////////////////////////////////////
+  double lookups = (double)(feats.size()) * rounds;
+  std::cout << "lookups\t" << lookups << "\thitRate\t" << hits / lookups << std::endl;
+  std::cout << "unordered_map\t" << lookups / mapTime << "\tlookups/sec" << std::endl;
+  std::cout << "WeightTable\t" << lookups / tableTime << "\tlookups/sec" << std::endl;
+  std::cout << "speedup\t" << mapTime / tableTime << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,68 @@
+/******************************************
+ *
+ * cascadeFilter.cpp
+ *
+ * Filter with a cascade of the filters' stages, as set out in a config
+ * file (see FilterCascade in arcFilter.h), e.g.
+ *
+ *   rules
+ *   linear linWeights.L1
+ *   quad quadWeights.L1
+ *   stages roles roots taboo quad
+ *   order cost sampleInput.dat
+ *
+ * which makes the same decisions as the quad filter.  With --stats,
+ * the stats say how many arcs each stage was given and how many of
+ * them it kept.
+ *
+ ******************************************/
+
+#include <iostream>   // For reading/writing STDIN
+#include <time.h>     // For timing:
+
+#include "arcFilter.h"
+
+const std::string USAGE = "USAGE: cat taggedFile | ./cascadeFilter [--threads N] [--serve SOCKET] [--format text|csr|bits] [--scores] [--stats FILE [--stats-interval SECONDS]] [--top-k K] [--head-margin M] cascadeConfig";
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+// Run program
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+int main(int nargin, char** argv) {
+  FilterOptions opts;
+  if (!parseFilterOptions(nargin, argv, opts) || nargin != 2) {
+    std::cerr << USAGE << std::endl;
+	exit(-1);
+  }
+
+  ////////////////////////////////////////////////
+  // First, read the cascade and load what its stages need:
+  ////////////////////////////////////////////////
+  FilterCascade cascade;
+  readCascade(argv[1], cascade);
+  ArcFilter filter(cascade);
+  filter.setHeadLimits(opts.headLimits);
+
+  // Nothing else uses C stdio, so cin and cout needn't stay in step with it:
+  std::ios::sync_with_stdio(false);
+
+  // Start timing of program
+  clock_t startTime = clock();
+
+  ////////////////////////////////////////////////
+  // Next, go through each line (sentence) of the input,
+  // apply the cascade and output decisions:
+  ////////////////////////////////////////////////
+  if (opts.socketPath != NULL)
+	filter.serve(opts);
+  else
+	filter.filterStream(std::cin, &std::cout, opts);
+
+  // Report timing
+  clock_t endTime = clock(); //record time that predicting ends
+  float time_task = ((double)(endTime - startTime)) / CLOCKS_PER_SEC;    //compute elapsed time of task
+  std::cerr << time_task << " seconds for filtering" << std::endl;
+
+  return 1;
+}
@@ -0,0 +1,219 @@
+/******************************************
+ * 
+ * compileModel.cpp
+ *
+ * Compile a text weight file into the binary image that the filters
+ * can mmap (see weightTable.h).  Pass the compiled file anywhere the
+ * filters take the text one.
+ *
+ * Text weights are pruned on the way: rows of all zeros, and rows no
+ * feature template could make, are dropped, and the image records
+ * which templates have any weights left, so that the filters can skip
+ * generating the rest (see featureTemplates.h).
+ *
+ * Linear weights can be packed as int8 or fp16 rows instead.  Given a
+ * tagged corpus too, this reports how many of the linear filters'
+ * decisions on it the packing changes.
+ *
+ ******************************************/
+
+#include <iostream>   // For reading/writing STDIN
+#include <fstream>    // For the corpus
+#include <string.h>   // For strcmp
+#include <math.h>     // For fabs
+
+#include "weightTable.h"
+#include "scoreKernel.h"
+
+const std::string USAGE = "USAGE: ./compileModel linear|linear-int8|linear-fp16|quad|pair textWeights compiledWeights [taggedFile]";
+
+// Compare the decisions of the float and packed weights on every token
+// of the corpus:
+static void reportDrift(const WeightTable &floatWeights, const WeightTable &packedWeights, const char *filename) {
+  std::ifstream corpus(filename);
+  if (!corpus) {
+    std::cerr << "Error! Corpus " << filename << " can not be opened" << std::endl;
+	exit(-1);
+  }
+  long tokens = 0, changedTokens = 0;
+  long changed[8] = { 0 };
+  float maxDiff = 0;
+  FeatureIds feats;
+  std::string input;
+  while (getline(corpus, input, '\n')) {
+	normLines(input);
+	StrVec words, tags;
+	readSentence(input, words, tags);
+	int sentSize = tags.size();
+	for (int i=1; i<sentSize; i++) {
+	  feats.clear();
+	  buildLinearFeatureIds(i, words, tags, sentSize, feats);
+	  float exact[8], packed[8];
+	  sumLinearScores(floatWeights, feats, exact);
+	  sumLinearScores(packedWeights, feats, packed);
+	  bool anyChanged = false;
+	  for (int f=0; f<8; f++) {
+		if ((exact[f] > LINEAR_THRESHOLD) != (packed[f] > LINEAR_THRESHOLD)) {
+		  changed[f]++;
+		  anyChanged = true;
+		}
+		if (fabs(exact[f] - packed[f]) > maxDiff) maxDiff = fabs(exact[f] - packed[f]);
+	  }
+	  tokens++;
+	  if (anyChanged) changedTokens++;
+	}
+  }
+  std::cerr << "Decisions changed on " << changedTokens << " of " << tokens << " tokens; per filter:";
+  for (int f=0; f<8; f++)
+	std::cerr << " " << changed[f];
+  std::cerr << "; largest score change " << maxDiff << std::endl;
+}
+
+// Report what pruning dropped, and the templates with no weights left:
+static void reportPruning(long zeroRows, long deadRows, long rows, const TemplateMask &live,
+						  int numTemplates, std::string (*templateName)(int)) {
+  std::cerr << "Dropped " << zeroRows << " rows of zeros and " << deadRows << " rows no template makes, of "
+			<< rows << std::endl;
+  if (numTemplates == 0) return;
+  int numDead = 0;
+  for (int t=0; t<numTemplates; t++) {
+	if (!live.has(t)) {
+	  std::cerr << (numDead == 0 ? "Templates without weights: " : " ") << templateName(t);
+	  numDead++;
+	}
+  }
+  if (numDead == 0)
+	std::cerr << "All " << numTemplates << " templates have weights" << std::endl;
+  else
+	std::cerr << std::endl;
+}
+
+// Compile text weights, dropping the rows that are all zeros or that no
+// feature template could make, and noting which templates have any.
+// (The pair filter's bias is kept even if it's zero; it has to be
+// there.)
+static void compileText(const char *filename, ModelKind kind, WeightTable &table) {
+  TemplateMask live;
+  live.clear();
+  long zeroRows = 0, deadRows = 0, rows;
+  if (kind == LINEAR_MODEL) {
+	LinearWeightsMap weights;
+	FeatureNames names;
+	initializeLinearWeights(filename, weights, &names);
+	rows = weights.size();
+	for (LinearWeightsMap::iterator itr = weights.begin(); itr != weights.end(); ) {
+	  bool zero = true;
+	  for (int i=0; i<8; i++)
+		if (itr->second[i] != 0) zero = false;
+	  if (zero) {
+		zeroRows++;
+		weights.erase(itr++);
+	  } else if (!matchLinearTemplates(names[itr->first], live)) {
+		deadRows++;
+		weights.erase(itr++);
+	  } else {
+		++itr;
+	  }
+	}
+	table.build(weights);
+	table.setTemplates(live);
+	reportPruning(zeroRows, deadRows, rows, live, NUMLINEARTEMPLATES, linearTemplateName);
+  } else if (kind == QUAD_MODEL) {
+	QuadWeightMap weights;
+	initializeQuadWeights(filename, weights);
+	rows = weights.size();
+	for (QuadWeightMap::iterator itr = weights.begin(); itr != weights.end(); ) {
+	  if (itr->second == 0) {
+		zeroRows++;
+		weights.erase(itr++);
+	  } else if (!matchQuadTemplates(itr->first, live)) {
+		deadRows++;
+		weights.erase(itr++);
+	  } else {
+		++itr;
+	  }
+	}
+	table.build(weights);
+	table.setTemplates(live);
+	reportPruning(zeroRows, deadRows, rows, live, NUMQUADTEMPLATES, quadTemplateName);
+  } else {
+	UltraPairWeightsMap weights;
+	initializeUltraPairWeights(filename, weights);
+	rows = weights.size();
+	for (UltraPairWeightsMap::iterator itr = weights.begin(); itr != weights.end(); ) {
+	  if (itr->second[0] == 0 && itr->second[1] == 0 && itr->first != "bias") {
+		zeroRows++;
+		weights.erase(itr++);
+	  } else if (!matchPairTemplates(itr->first)) {
+		deadRows++;
+		weights.erase(itr++);
+	  } else {
+		++itr;
+	  }
+	}
+	table.build(weights);
+	reportPruning(zeroRows, deadRows, rows, live, 0, NULL);
+  }
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+// Run program
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+int main(int nargin, char** argv) {
+  if (nargin != 4 && nargin != 5) {
+    std::cerr << USAGE << std::endl;
+	exit(-1);
+  }
+
+  ModelKind kind;
+  RowEncoding packAs = FLOAT_ROWS;
+  if (strcmp(argv[1], "linear") == 0)
+	kind = LINEAR_MODEL;
+  else if (strcmp(argv[1], "linear-int8") == 0) {
+	kind = LINEAR_MODEL;
+	packAs = INT8_ROWS;
+  } else if (strcmp(argv[1], "linear-fp16") == 0) {
+	kind = LINEAR_MODEL;
+	packAs = FP16_ROWS;
+  } else if (strcmp(argv[1], "quad") == 0)
+	kind = QUAD_MODEL;
+  else if (strcmp(argv[1], "pair") == 0)
+	kind = PAIR_MODEL;
+  else {
+    std::cerr << USAGE << std::endl;
+	exit(-1);
+  }
+
+  ////////////////////////////////////////////////
+  // Load the weights (text, which gets pruned, or an older image),
+  // then write the image:
+  ////////////////////////////////////////////////
+  WeightTable weights;
+  if (WeightTable::isImage(argv[2]))
+	weights.load(argv[2], kind);
+  else
+	compileText(argv[2], kind, weights);
+  if (packAs != FLOAT_ROWS) {
+	if (weights.encoding() != FLOAT_ROWS) {
+	  std::cerr << "Error! " << argv[2] << " is already packed" << std::endl;
+	  exit(-1);
+	}
+	WeightTable packed;
+	packed.pack(weights, packAs);
+	if (nargin == 5)
+	  reportDrift(weights, packed, argv[4]);
+	packed.save(argv[3]);
+	std::cerr << packed.size() << " packed rows written to " << argv[3] << std::endl;
+	return 0;
+  }
+  if (nargin == 5) {
+    std::cerr << USAGE << std::endl;
+	exit(-1);
+  }
+  weights.save(argv[3]);
+  std::cerr << weights.size() << " rows of " << weights.rowWidth() << " written to " << argv[3] << std::endl;
+
+  return 0;
+}
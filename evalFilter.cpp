@@ -0,0 +1,121 @@
+/******************************************
+ * 
+ * evalFilter.cpp
+ *
+ * Evaluate a filter against the gold heads in its input (the third
+ * field of each word_tag_head triple; tokens with "*" have none): in
+ * one pass, sweep a grid of margins on the filters' thresholds, and
+ * report for each setting the recall of the gold arcs and how many of
+ * the candidate arcs are pruned, as tab-separated columns.
+ *
+ ******************************************/
+
+#include <iostream>   // For reading/writing STDIN
+#include <stdlib.h>   // For strtod
+#include <string.h>   // For strcmp
+
+#include "arcFilter.h"
+#include "lineReader.h"
+
+const std::string USAGE = "USAGE: cat taggedFile | ./evalFilter [--role-margins m1,m2,...] [--score-margins m1,m2,...] rule|linear|quad|ultra weightsA weightsB\n       cat taggedFile | ./evalFilter cascade cascadeConfig";
+
+const char *DEFAULTMARGINS = "-1,-0.5,-0.2,-0.1,0,0.1,0.2,0.5,1,2";
+
+// Read a comma-separated list of margins:
+static bool parseMargins(const char *list, std::vector<float> &margins) {
+  margins.clear();
+  const char *p = list;
+  for (;;) {
+	char *end;
+	margins.push_back(strtod(p, &end));
+	if (end == p) return false;
+	if (*end == '\0') return true;
+	if (*end != ',') return false;
+	p = end + 1;
+  }
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+// Run program
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+int main(int nargin, char** argv) {
+  MarginGrid grid;
+  parseMargins(DEFAULTMARGINS, grid.roleMargins);
+  parseMargins(DEFAULTMARGINS, grid.scoreMargins);
+  int kept = 1;
+  for (int i=1; i<nargin; i++) {
+	if (strcmp(argv[i], "--role-margins") == 0 && i+1 < nargin) {
+	  if (!parseMargins(argv[++i], grid.roleMargins)) nargin = 0;
+	} else if (strcmp(argv[i], "--score-margins") == 0 && i+1 < nargin) {
+	  if (!parseMargins(argv[++i], grid.scoreMargins)) nargin = 0;
+	} else {
+	  argv[kept++] = argv[i];
+	}
+  }
+  bool isCascade = (kept > 1 && strcmp(argv[1], "cascade") == 0);
+  if (nargin == 0 || kept != (isCascade ? 3 : 4)) {
+    std::cerr << USAGE << std::endl;
+	exit(-1);
+  }
+  FilterType type;
+  if (isCascade) type = CASCADE_FILTER;
+  else if (strcmp(argv[1], "rule") == 0) type = RULE_FILTER;
+  else if (strcmp(argv[1], "linear") == 0) type = LINEAR_FILTER;
+  else if (strcmp(argv[1], "quad") == 0) type = QUAD_FILTER;
+  else if (strcmp(argv[1], "ultra") == 0) type = ULTRA_FILTER;
+  else {
+    std::cerr << USAGE << std::endl;
+	exit(-1);
+  }
+  // Only sweep the margins the filter has:
+  if (type == RULE_FILTER || type == CASCADE_FILTER)
+	grid.roleMargins.assign(1, 0);
+  if (type == RULE_FILTER || type == LINEAR_FILTER || type == CASCADE_FILTER)
+	grid.scoreMargins.assign(1, 0);
+
+  FilterCascade cascade;
+  if (isCascade)
+	readCascade(argv[2], cascade);
+  ArcFilter *filter = isCascade ? new ArcFilter(cascade) : new ArcFilter(type, argv[2], argv[3]);
+
+  ////////////////////////////////////////////////
+  // Sweep every sentence:
+  ////////////////////////////////////////////////
+  std::ios::sync_with_stdio(false);
+  SweepCounts counts(grid);
+  LineReader reader(std::cin);
+  char *line;
+  int len;
+  Sentence sent;
+  std::vector<int> goldHeads;
+  while (reader.nextLine(line, len)) {
+	readSentence(line, len, sent.words, sent.tags, &goldHeads);
+	filter->sweepSentence(sent, goldHeads, grid, counts);
+  }
+  std::cerr << counts.sentences << " sentences, " << counts.goldArcs << " gold arcs";
+  if (counts.unfitSentences > 0)
+	std::cerr << " (" << counts.unfitSentences << " sentences too long to filter, skipped)";
+  std::cerr << std::endl;
+
+  ////////////////////////////////////////////////
+  // Report each setting:
+  ////////////////////////////////////////////////
+  std::cout << "roleMargin\tscoreMargin\tgoldKept\tgoldArcs\trecall\tarcsKept\tarcs\treduction" << std::endl;
+  int numScore = grid.scoreMargins.size();
+  for (int r=0; r<(int)(grid.roleMargins.size()); r++) {
+	for (int s=0; s<numScore; s++) {
+	  uint64_t goldKept = counts.goldKept[r * numScore + s];
+	  uint64_t arcsKept = counts.arcsKept[r * numScore + s];
+	  std::cout << grid.roleMargins[r] << "\t" << grid.scoreMargins[s] << "\t"
+				<< goldKept << "\t" << counts.goldArcs << "\t"
+				<< (counts.goldArcs > 0 ? (double)goldKept / counts.goldArcs : 0) << "\t"
+				<< arcsKept << "\t" << counts.arcs << "\t"
+				<< (counts.arcs > 0 ? 1 - (double)arcsKept / counts.arcs : 0) << std::endl;
+	}
+  }
+  delete filter;
+
+  return 0;
+}
@@ -0,0 +1,179 @@
+/******************************************
+ *
+ * featureTemplates.cpp
+ *
+ ******************************************/
+
+#include "featureTemplates.h"
+
+#include <ctype.h>    // For isdigit
+#include <string.h>   // For strlen
+
+// The feature strings, as patterns.  Besides literal characters:
+//   %w  a word: any string, even an empty one
+//   %t  a tag (or "~" off the end of the sentence): any nonempty string
+//   %n  a number, perhaps negative
+//   %b  a binned distance: a number, ">25" or "<-25"
+//   %P  a prefix, four characters     %p  the same, or none
+//   %S  a suffix, two characters      %s  the same, or none
+//   %h  a word shape, one to five characters
+//   %d  a direction, "<" or ">"
+static bool matches(const char *s, const char *p);
+
+// Match the rest of the pattern after skipping n characters of s, for
+// each n from min to max that s has:
+static bool matchesAfter(const char *s, int min, int max, const char *rest) {
+  int len = strlen(s);
+  for (int n=min; n<=max && n<=len; n++)
+	if (matches(s + n, rest)) return true;
+  return false;
+}
+
+static bool matches(const char *s, const char *p) {
+  if (*p == '\0') return *s == '\0';
+  if (*p != '%') return *s == *p && matches(s + 1, p + 1);
+  const char *rest = p + 2;
+  switch (p[1]) {
+  case 'w': return matchesAfter(s, 0, strlen(s), rest);
+  case 't': return matchesAfter(s, 1, strlen(s), rest);
+  case 'P': return matchesAfter(s, 4, 4, rest);
+  case 'p': return matches(s, rest) || matchesAfter(s, 4, 4, rest);
+  case 'S': return matchesAfter(s, 2, 2, rest);
+  case 's': return matches(s, rest) || matchesAfter(s, 2, 2, rest);
+  case 'h': return matchesAfter(s, 1, 5, rest);
+  case 'd': return (*s == '<' || *s == '>') && matches(s + 1, rest);
+  case 'b':
+	if (strncmp(s, ">25", 3) == 0 && matches(s + 3, rest)) return true;
+	if (strncmp(s, "<-25", 4) == 0 && matches(s + 4, rest)) return true;
+	// Otherwise, it's a number:
+  case 'n': {
+	int n = (*s == '-') ? 1 : 0;
+	while (isdigit(s[n])) {
+	  n++;
+	  if (matches(s + n, rest)) return true;
+	}
+	return false;
+  }
+  }
+  return false;
+}
+
+// The patterns of featureTemplates.def's pieces:
+#define PATTERN_NOTHING ""
+#define PATTERN_WORD "%w"
+#define PATTERN_TAG "%t"
+#define PATTERN_PREFIX "%P"
+#define PATTERN_SUFFIX "%S"
+#define PATTERN_ANY_PREFIX "%p"
+#define PATTERN_ANY_SUFFIX "%s"
+#define PATTERN_SHAPE "%h"
+#define PATTERN_POSITION "%n"
+#define PATTERN_SIZE "%n"
+#define PATTERN_REVERSE "%n"
+#define PATTERN_REVERSE_BIN "%b"
+#define PATTERN_LEFT_WORD "%w"
+#define PATTERN_RIGHT_WORD "%w"
+#define PATTERN_LEFT_TAG "%t"
+#define PATTERN_RIGHT_TAG "%t"
+#define PATTERN_LEFT_TAG2 "%t"
+#define PATTERN_RIGHT_TAG2 "%t"
+
+// As buildLinearFeatureIds makes them:
+static const char *TOKENPATTERNS[NUMTOKENTEMPLATES] = {
+#define LINEAR_TOKEN(id, name, lit, piece, lit2, piece2) lit PATTERN_##piece lit2 PATTERN_##piece2,
+#define LINEAR_BIAS(id, name, lit) lit,
+#include "featureTemplates.def"
+};
+static const char *TOKENNAMES[NUMTOKENTEMPLATES] = {
+#define LINEAR_TOKEN(id, name, lit, piece, lit2, piece2) name,
+#define LINEAR_BIAS(id, name, lit) name,
+#include "featureTemplates.def"
+};
+
+struct AtomicPattern {
+  AtomicTemplate atomic;
+  const char *pattern;
+};
+static const AtomicPattern ATOMICPATTERNS[] = {
+#define LINEAR_ATOMIC(id, name, lit, piece, lit2, piece2) { id, lit PATTERN_##piece lit2 PATTERN_##piece2 },
+#define LINEAR_NEIGHBOURS(id, name, left, right, dot, maxDist) \
+  { id, left "%t" }, { id, left "%t" dot "%n" }, { id, right "%t" }, { id, right "%t" dot "%n" },
+#include "featureTemplates.def"
+};
+static const char *ATOMICNAMES[NUMATOMICTEMPLATES] = {
+#define LINEAR_ATOMIC(id, name, lit, piece, lit2, piece2) name,
+#define LINEAR_NEIGHBOURS(id, name, left, right, dot, maxDist) name,
+#include "featureTemplates.def"
+};
+static const char *CONJUNCTIONPATTERNS[NUMCONJUNCTIONS] = {
+#define LINEAR_CONJUNCTION(id, name, lit, piece) lit PATTERN_##piece,
+#include "featureTemplates.def"
+};
+static const char *CONJUNCTIONNAMES[NUMCONJUNCTIONS] = {
+#define LINEAR_CONJUNCTION(id, name, lit, piece) name,
+#include "featureTemplates.def"
+};
+
+// As buildQuadraticFeatureVector makes them:
+struct QuadPattern {
+  QuadTemplate quad;
+  const char *pattern;
+};
+static const QuadPattern QUADPATTERNS[] = {
+#define QUAD_TEMPLATE(id, name, pattern) { id, pattern },
+#include "featureTemplates.def"
+};
+static const char *QUADNAMES[NUMQUADTEMPLATES] = {
+#define QUAD_TEMPLATE(id, name, pattern) name,
+#include "featureTemplates.def"
+};
+
+bool matchLinearTemplates(const std::string &feat, TemplateMask &live) {
+  const char *s = feat.c_str();
+  bool any = false;
+  for (int t=0; t<NUMTOKENTEMPLATES; t++) {
+	if (matches(s, TOKENPATTERNS[t])) {
+	  live.set(linearTemplate((TokenTemplate)t));
+	  any = true;
+	}
+  }
+  for (size_t a=0; a<sizeof(ATOMICPATTERNS) / sizeof(ATOMICPATTERNS[0]); a++) {
+	for (int c=0; c<NUMCONJUNCTIONS; c++) {
+	  std::string pattern = std::string(ATOMICPATTERNS[a].pattern) + CONJUNCTIONPATTERNS[c];
+	  if (matches(s, pattern.c_str())) {
+		live.set(linearTemplate(ATOMICPATTERNS[a].atomic, (Conjunction)c));
+		any = true;
+	  }
+	}
+  }
+  return any;
+}
+
+bool matchQuadTemplates(const std::string &feat, TemplateMask &live) {
+  const char *s = feat.c_str();
+  bool any = false;
+  for (size_t q=0; q<sizeof(QUADPATTERNS) / sizeof(QUADPATTERNS[0]); q++) {
+	if (matches(s, QUADPATTERNS[q].pattern)) {
+	  live.set(QUADPATTERNS[q].quad);
+	  any = true;
+	}
+  }
+  return any;
+}
+
+// As ArcFilter::findPairRow makes them:
+bool matchPairTemplates(const std::string &feat) {
+  const char *s = feat.c_str();
+  return matches(s, "h%t<m%t") || matches(s, "m%t<h%t") || feat == "bias";
+}
+
+std::string linearTemplateName(int t) {
+  if (t < NUMTOKENTEMPLATES)
+	return TOKENNAMES[t];
+  t -= NUMTOKENTEMPLATES;
+  return std::string(ATOMICNAMES[t / NUMCONJUNCTIONS]) + CONJUNCTIONNAMES[t % NUMCONJUNCTIONS];
+}
+
+std::string quadTemplateName(int t) {
+  return QUADNAMES[t];
+}
@@ -0,0 +1,99 @@
+/******************************************
+ *
+ * featureTemplates.h
+ *
+ * The families of features that the linear and quad filters generate.
+ * A compiled model records which of them it has any weights for, and
+ * the extractors skip the rest: their features could only ever miss.
+ *
+ * compileModel works out which templates could have made each weight
+ * from its feature string.  Words and tags can be any strings, so a
+ * string can often be split more than one way; every template that
+ * could have made it counts as having weights.
+ *
+ * The templates themselves are in featureTemplates.def.
+ *
+ ******************************************/
+
+#ifndef FEATURETEMPLATES_H
+#define FEATURETEMPLATES_H
+
+#include <stdint.h>   // For the mask's words
+#include <string>
+
+// The linear features of the token itself, as featureTemplates.def
+// lists them:
+enum TokenTemplate {
+#define LINEAR_TOKEN(id, name, lit, piece, lit2, piece2) id,
+#define LINEAR_BIAS(id, name, lit) id,
+#include "featureTemplates.def"
+  NUMTOKENTEMPLATES
+};
+
+// The atomic linear features, each of which is also conjoined with
+// the token's word, tag, prefix, suffix and shape.  The neighbouring
+// tags, with and without their distances, go together, since they're
+// all made in one set:
+enum AtomicTemplate {
+#define LINEAR_ATOMIC(id, name, lit, piece, lit2, piece2) id,
+#define LINEAR_NEIGHBOURS(id, name, left, right, dot, maxDist) id,
+#include "featureTemplates.def"
+  NUMATOMICTEMPLATES
+};
+enum Conjunction {
+#define LINEAR_CONJUNCTION(id, name, lit, piece) id,
+#include "featureTemplates.def"
+  NUMCONJUNCTIONS
+};
+
+// Their numbers in a linear model's TemplateMask:
+inline int linearTemplate(TokenTemplate t) {
+  return t;
+}
+inline int linearTemplate(AtomicTemplate a, Conjunction c) {
+  return NUMTOKENTEMPLATES + a * NUMCONJUNCTIONS + c;
+}
+const int NUMLINEARTEMPLATES = NUMTOKENTEMPLATES + NUMATOMICTEMPLATES * NUMCONJUNCTIONS;
+
+// The quad features, numbered as in a quad model's TemplateMask.  The
+// direction, distance, tag-pair, key-triple and bias weights are all
+// looked up once, when the filter loads, so only the rest get skipped:
+enum QuadTemplate {
+#define QUAD_TEMPLATE(id, name, pattern) id,
+#include "featureTemplates.def"
+  NUMQUADTEMPLATES
+};
+
+// One bit per template, set if the model has weights for it.  Models
+// loaded from text, or compiled from an image without one, have all of
+// them set:
+struct TemplateMask {
+  uint64_t bits[2];
+
+  TemplateMask() { bits[0] = bits[1] = ~(uint64_t)0; }
+  bool has(int t) const { return (bits[t >> 6] >> (t & 63)) & 1; }
+  void set(int t) { bits[t >> 6] |= (uint64_t)1 << (t & 63); }
+  void clear() { bits[0] = bits[1] = 0; }
+
+  // The conjunctions of an atomic feature that have weights, as a mask
+  // over Conjunction:
+  unsigned int conjunctions(AtomicTemplate a) const {
+	unsigned int conj = 0;
+	for (int c=0; c<NUMCONJUNCTIONS; c++)
+	  if (has(linearTemplate(a, (Conjunction)c))) conj |= 1 << c;
+	return conj;
+  }
+};
+
+// Mark the templates that could have made this feature in live,
+// returning false if none could:
+bool matchLinearTemplates(const std::string &feat, TemplateMask &live);
+bool matchQuadTemplates(const std::string &feat, TemplateMask &live);
+// The same for the ultra filter's pair weights, which have no mask:
+bool matchPairTemplates(const std::string &feat);
+
+// The templates' names, for reports:
+std::string linearTemplateName(int t);
+std::string quadTemplateName(int t);
+
+#endif // FEATURETEMPLATES_H
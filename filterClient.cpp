@@ -0,0 +1,99 @@
+/******************************************
+ *
+ * filterClient.cpp
+ *
+ * Send a tagged file to a filter started with --serve, writing its
+ * decisions to STDOUT just as the filter itself would have.  The input
+ * is sent while the answers come back, so a long file never waits on
+ * its own output.
+ *
+ ******************************************/
+
+#include <iostream>     // For reading/writing STDIN
+#include <pthread.h>    // For sending while receiving
+#include <errno.h>      // For EINTR
+#include <string.h>     // For memset, strcpy, strlen
+#include <unistd.h>     // For read, write, close
+#include <sys/socket.h> // For the socket
+#include <sys/un.h>     // For sockaddr_un
+
+const std::string USAGE = "USAGE: cat taggedFile | ./filterClient socket";
+
+const int COPYSIZE = 1 << 16;
+
+// Write all n bytes, or return false:
+static bool writeAll(int fd, const char *p, ssize_t n) {
+  while (n > 0) {
+	ssize_t written = write(fd, p, n);
+	if (written < 0 && errno == EINTR) continue;
+	if (written <= 0) return false;
+	p += written;
+	n -= written;
+  }
+  return true;
+}
+
+// Copy STDIN to the server, then say that's all:
+static void *sendInput(void *arg) {
+  int fd = *(int *)arg;
+  char buf[COPYSIZE];
+  for (;;) {
+	ssize_t n = read(0, buf, sizeof(buf));
+	if (n < 0 && errno == EINTR) continue;
+	if (n <= 0 || !writeAll(fd, buf, n)) break;
+  }
+  shutdown(fd, SHUT_WR);
+  return NULL;
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+// Run program
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+int main(int nargin, char** argv) {
+  if (nargin != 2) {
+    std::cerr << USAGE << std::endl;
+	exit(-1);
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+    std::cerr << "Error! Socket path " << argv[1] << " is too long" << std::endl;
+	exit(-1);
+  }
+  strcpy(addr.sun_path, argv[1]);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    std::cerr << "Error! Could not connect to " << argv[1] << std::endl;
+	exit(-1);
+  }
+
+  pthread_t sender;
+  if (pthread_create(&sender, NULL, sendInput, &fd) != 0) {
+    std::cerr << "Error! Could not start the sending thread" << std::endl;
+	exit(-1);
+  }
+
+  // Copy the answers to STDOUT until the server closes:
+  char buf[COPYSIZE];
+  for (;;) {
+	ssize_t n = read(fd, buf, sizeof(buf));
+	if (n < 0 && errno == EINTR) continue;
+	if (n < 0) {
+	  std::cerr << "Error! Lost the connection to " << argv[1] << std::endl;
+	  exit(-1);
+	}
+	if (n == 0) break;
+	if (!writeAll(1, buf, n)) {
+	  std::cerr << "Error! Could not write the output" << std::endl;
+	  exit(-1);
+	}
+  }
+  pthread_join(sender, NULL);
+  close(fd);
+
+  return 0;
+}
@@ -8,14 +8,22 @@
  ******************************************/
 
 #include "filterCommon.h"
+#include "weightTable.h"
+#include "scoreKernel.h"
 
 #include <cassert>    // For error checking
 #include <iostream>   // For reading/writing STDIN
 #include <fstream>    // For reading files
 #include <iterator>   // For debugging
+#include <sstream>    // For parsing the input
+#include <algorithm>  // For min and max
 
-const int MAXDIST = 5;       // For the span of the neighbour tag inclusion in linear
-const int WIDTH = 5;         // For the scope of between-tag finding in quadratic
+// For the span of the neighbour tag inclusion in linear, from
+// featureTemplates.def:
+const int MAXDIST = 0
+#define LINEAR_NEIGHBOURS(id, name, left, right, dot, maxDist) + maxDist
+#include "featureTemplates.def"
+  ;
 
 // Quantize the distance into several ranges, currently used for
 // head-mod links and mod-root links.
@@ -35,6 +43,19 @@ inline std::string binDistance(int d) {
   return "ERROR";
 }
 
+// The same, added to the end of a feature ID:
+inline FeatureId extendIdBinDistance(FeatureId id, int d) {
+  if (d < 15 && d > -15) {
+    return extendIdNum(id, d);
+  } else if (d < 25 && d > -25) {
+	d = d/2;
+    return extendIdNum(id, d * 2);
+  } else if (d >= 25) {
+    return extendId(id, ">25");
+  }
+  return extendId(id, "<-25");
+}
+
 // Load in all the rules for simple filtering of arcs
 void initializeTaboos(RuleLists& tabooHeads, RuleLists& noLeftHead, RuleLists& noRightHead, RuleLists& tabooPairs) {
   // unlikely heads:
@@ -55,6 +76,101 @@ void initializeTaboos(RuleLists& tabooHeads, RuleLists& noLeftHead, RuleLists& n
   tabooPairs.insert("mIN<hDT"); tabooPairs.insert("mNN<hDT"); tabooPairs.insert("mNNP<hIN");
 }
 
+// Load in the tag set that tags are interned from: the Penn Treebank
+// tags, as normLines leaves them, plus the artificial root's:
+void initializeTagSet(TagIndex& tagSet) {
+  static const char *tags[] = {
+	"ROOT", "CC", "CD", "DT", "EX", "FW", "IN", "JJ", "JJR", "JJS", "LS", "MD",
+	"NN", "NNS", "NNP", "NNPS", "PDT", "POS", "PRP", "PRP$", "RB", "RBR", "RBS",
+	"RP", "SYM", "TO", "UH", "VB", "VBD", "VBG", "VBN", "VBP", "VBZ", "WDT", "WP",
+	"WP$", "WRB", "$", "|", "``", "''", ",", ".", ";", "LRB", "RRB", "-LRB-", "-RRB-"
+  };
+  assert(sizeof(tags) / sizeof(tags[0]) <= MAXTAGS);
+  for (int i=0; i<(int)(sizeof(tags) / sizeof(tags[0])); i++)
+	tagSet.insert(std::make_pair(std::string(tags[i]), i));
+}
+
+// Read a preprocessed line of word_tag_head triples into the word and
+// tag arrays:
+void readSentence(const std::string &input, StrVec &words, StrVec &tags) {
+  // Parse this line with a string stream:
+  std::stringstream line(input);
+  // For each element (word+tag+head) in this line:
+  std::string element;
+  while (getline(line, element, ' ')) {
+    std::stringstream triple(element);
+    std::string word, tag;
+    getline(triple, word, '_');
+    normWords(word);
+    words.push_back(word);
+    getline(triple, tag, '_');
+    tags.push_back(tag);
+  }
+}
+
+// The same for a raw line, preprocessing it in the same pass.  As with
+// getline, every space ends a triple, except that a last empty triple
+// is dropped; the word runs to the first '_' and the tag to the next.
+void readSentence(char *line, int len, StrVec &words, StrVec &tags, std::vector<int> *heads) {
+  char *p = line;
+  char *end = line + len;
+  int n = 0;
+  while (p < end) {
+	// The word: normLines, then normWords
+	char *word = p;
+	for (; p < end && *p != ' ' && *p != '_'; p++) {
+	  if (*p == '#')
+		*p = '|';
+	  else if (*p == ':')
+		*p = ';';
+	  else if (isdigit(*p))
+		*p = '0';
+	}
+	int wordLen = p - word;
+	// The tag: normLines only
+	char *tag = p;
+	if (p < end && *p == '_') {
+	  tag = ++p;
+	  for (; p < end && *p != ' ' && *p != '_'; p++) {
+		if (*p == '#')
+		  *p = '|';
+		else if (*p == ':')
+		  *p = ';';
+	  }
+	}
+	int tagLen = p - tag;
+	// Skip the head, unless it's wanted:
+	if (heads != NULL) {
+	  if ((int)(heads->size()) == n) heads->push_back(-1);
+	  (*heads)[n] = -1;
+	  if (p < end && *p == '_') {
+		char *head = ++p;
+		bool negative = (p < end && *p == '-');
+		if (negative) p++;
+		int value = 0;
+		for (; p < end && isdigit(*p); p++)
+		  value = 10 * value + (*p - '0');
+		if (p > head + (negative ? 1 : 0) && (p == end || *p == ' '))
+		  (*heads)[n] = negative ? -value : value;
+	  }
+	}
+	while (p < end && *p != ' ') p++;
+
+	if ((int)(words.size()) == n) {
+	  words.push_back(std::string());
+	  tags.push_back(std::string());
+	}
+	words[n].assign(word, wordLen);
+	tags[n].assign(tag, tagLen);
+	n++;
+	// Step over the space that ended this triple:
+	if (p < end) p++;
+  }
+  words.resize(n);
+  tags.resize(n);
+  if (heads != NULL) heads->resize(n);
+}
+
 // Build a feature vector given the current words and tags:
 void buildLinearFeatureVector(int pos, const StrVec &words, const StrVec &tags, int sentSize, StrVec &feats) {
   // Get all the relevant information:
@@ -195,6 +311,236 @@ void buildLinearFeatureVector(int pos, const StrVec &words, const StrVec &tags,
   feats.push_back("bias");
 }
 
+// Every template, for when there's no mask:
+static const TemplateMask ALLTEMPLATES;
+
+// The most atomic features a token can have, counting each of the
+// neighbour tags:
+const int MAXATOMICS = 0
+#define LINEAR_ATOMIC(id, name, lit, piece, lit2, piece2) + 1
+#define LINEAR_NEIGHBOURS(id, name, left, right, dot, maxDist) + 4*(maxDist)
+#include "featureTemplates.def"
+  ;
+
+// Add an atomic feature, if any of its conjunctions are wanted:
+static inline void addAtomic(FeatureId featId, unsigned int conj, FeatureId *atomicFeats,
+							 unsigned int *atomicConj, int &nAtomic) {
+  if (conj == 0) return;
+  atomicFeats[nAtomic] = featId;
+  atomicConj[nAtomic++] = conj;
+}
+
+// The neighbour tags' IDs, kept just as the std::tr1::unordered_set of
+// them in buildLinearFeatureVector keeps its strings (with the same
+// hashes), but in arrays on the stack.  The set starts with 11
+// buckets, each a list with the latest ID first, walked in order.  An
+// ID that would leave it with more IDs than buckets first rehashes it
+// into the next of its primes (at least twice as many buckets), taking
+// each old bucket's IDs in turn onto the front of their new ones.
+// That's enough buckets for a maxDist of up to 102:
+static const int NBHPRIMES[] = { 11, 23, 47, 97, 199, 409 };
+const int MAXNBHBUCKETS = 409;
+struct NeighbourTagSet {
+  FeatureId ids[4*MAXDIST];
+  int next[4*MAXDIST];       // The next ID in its bucket, or -1
+  int buckets[MAXNBHBUCKETS];  // The first ID in each, or -1
+  int numIds, numBuckets, prime;
+
+  NeighbourTagSet() : numIds(0), numBuckets(NBHPRIMES[0]), prime(0) {
+	for (int b=0; b<numBuckets; b++) buckets[b] = -1;
+  }
+
+  void insert(FeatureId id) {
+	for (int i=buckets[id % numBuckets]; i >= 0; i=next[i])
+	  if (ids[i] == id) return;
+	if (numIds == numBuckets) rehash();
+	int b = id % numBuckets;
+	ids[numIds] = id;
+	next[numIds] = buckets[b];
+	buckets[b] = numIds++;
+  }
+
+  void rehash() {
+	int newBuckets[MAXNBHBUCKETS];
+	int newNum = NBHPRIMES[++prime];
+	for (int b=0; b<newNum; b++) newBuckets[b] = -1;
+	for (int b=0; b<numBuckets; b++) {
+	  while (buckets[b] >= 0) {
+		int i = buckets[b];
+		buckets[b] = next[i];
+		int nb = ids[i] % newNum;
+		next[i] = newBuckets[nb];
+		newBuckets[nb] = i;
+	  }
+	}
+	numBuckets = newNum;
+	for (int b=0; b<numBuckets; b++) buckets[b] = newBuckets[b];
+  }
+};
+
+// Add the tags up to maxDist to the left and right of pos, each alone
+// and with its distance, as atomic features, in the set's order:
+static inline void addNeighbourTags(int pos, const StrVec &tags, int sentSize, const char *left, const char *right,
+									const char *dot, int maxDist, unsigned int conj, FeatureId *atomicFeats,
+									unsigned int *atomicConj, int &nAtomic) {
+  NeighbourTagSet nbhTags;
+  FeatureId featId;
+  int startSpot = 1;
+  if (pos - maxDist > 1) startSpot = pos - maxDist;
+  for (int currSpot=startSpot; currSpot < pos; currSpot++) {
+	featId = extendId(extendId(EMPTY_ID, left), tags[currSpot]); nbhTags.insert(featId);
+	featId = extendIdNum(extendId(featId, dot), pos-currSpot); nbhTags.insert(featId);
+  }
+  int endSpot = sentSize;
+  if (pos + maxDist + 1 < sentSize) endSpot = pos + maxDist + 1;
+  for (int currSpot=pos+1; currSpot < endSpot; currSpot++) {
+	featId = extendId(extendId(EMPTY_ID, right), tags[currSpot]); nbhTags.insert(featId);
+	featId = extendIdNum(extendId(featId, dot), currSpot-pos); nbhTags.insert(featId);
+  }
+  for (int b=0; b<nbhTags.numBuckets; b++)
+	for (int i=nbhTags.buckets[b]; i >= 0; i=nbhTags.next[i])
+	  addAtomic(nbhTags.ids[i], conj, atomicFeats, atomicConj, nAtomic);
+}
+
+// How featureTemplates.def's pieces get added to the end of an ID, and
+// whether the token has them:
+#define ID_NOTHING(id) (id)
+#define ID_WORD(id) extendId(id, wh)
+#define ID_TAG(id) extendId(id, th)
+#define ID_PREFIX(id) extendId(id, pref, prefLen)
+#define ID_SUFFIX(id) extendId(id, suff, suffLen)
+#define ID_ANY_PREFIX(id) extendId(id, pref, prefLen)
+#define ID_ANY_SUFFIX(id) extendId(id, suff, suffLen)
+#define ID_SHAPE(id) extendId(id, wordShape, shapeLen)
+#define ID_POSITION(id) extendIdNum(id, pos)
+#define ID_SIZE(id) extendIdNum(id, sentSize)
+#define ID_REVERSE(id) extendIdNum(id, sentSize - pos)
+#define ID_REVERSE_BIN(id) extendIdBinDistance(id, sentSize - pos)
+#define ID_LEFT_WORD(id) extendId(id, whl)
+#define ID_RIGHT_WORD(id) extendId(id, whr)
+#define ID_LEFT_TAG(id) extendId(id, thl)
+#define ID_RIGHT_TAG(id) extendId(id, thr)
+#define ID_LEFT_TAG2(id) extendId(id, thll)
+#define ID_RIGHT_TAG2(id) extendId(id, thrr)
+#define HAS_NOTHING true
+#define HAS_WORD true
+#define HAS_TAG true
+#define HAS_PREFIX (prefLen > 0)
+#define HAS_SUFFIX (suffLen > 0)
+#define HAS_SHAPE true
+// The ID of lit + piece + lit2 + piece2:
+#define TEMPLATE_ID(lit, piece, lit2, piece2) ID_##piece2(extendId(ID_##piece(extendId(EMPTY_ID, lit)), lit2))
+
+// The same features as IDs, in the same order, without building any
+// of the strings.  The code is featureTemplates.def's, one template
+// after another, and the neighbour tags go through a NeighbourTagSet,
+// so that the weights get summed in exactly the same order.  Leaving
+// out the features that no weight has doesn't change the order of the
+// rest.
+void buildLinearFeatureIds(int pos, const StrVec &words, const StrVec &tags, int sentSize, FeatureIds &feats,
+						   const TemplateMask *templates) {
+  static const std::string NONE = "~";
+  const TemplateMask &on = (templates != NULL) ? *templates : ALLTEMPLATES;
+  // Get all the relevant information:
+  const std::string &wh = words[pos];
+  const std::string &th = tags[pos];
+  const std::string &whl = (pos-1 > 0 && pos-1 < sentSize) ? words[pos-1] : NONE;
+  const std::string &thl = (pos-1 > 0 && pos-1 < sentSize) ? tags[pos-1] : NONE;
+  const std::string &whr = (pos+1 > 0 && pos+1 < sentSize) ? words[pos+1] : NONE;
+  const std::string &thr = (pos+1 > 0 && pos+1 < sentSize) ? tags[pos+1] : NONE;
+  const std::string &thll = (pos-2 > 0 && pos-2 < sentSize) ? tags[pos-2] : NONE;
+  const std::string &thrr = (pos+2 > 0 && pos+2 < sentSize) ? tags[pos+2] : NONE;
+
+  // First: get the prefix and suffix, if possible:
+  int whLen = wh.size();
+  int prefLen = 0, suffLen = 0;
+  if (whLen > 2) {
+	suffLen = 2;
+	if (whLen > 4)
+	  prefLen = 4;
+  }
+  const char *pref = wh.data();
+  const char *suff = wh.data() + whLen - suffLen;
+
+  // Then, the shape of the word, at most five characters.  (An empty
+  // word gets the '\0' that the string version reads off its end.)
+  char wordShape[5];
+  int shapeLen = 1;
+  char prev = 0;
+  for (int j=0; j<whLen || j==0; j++) {
+	char c = (j < whLen) ? wh[j] : 0;
+	if (isupper(c))
+	  c = 'A';
+	else if (islower(c))
+	  c = 'a';
+	if (j == 0)
+	  wordShape[0] = c;
+	else if ((c != prev || (c != 'A' && c != 'a')) && shapeLen < 5)
+	  wordShape[shapeLen++] = c;
+	prev = c;
+  }
+
+  // The token's own features:
+#define LINEAR_TOKEN(t, name, lit, piece, lit2, piece2) \
+  if (on.has(t) && HAS_##piece && HAS_##piece2) feats.push_back(TEMPLATE_ID(lit, piece, lit2, piece2));
+#include "featureTemplates.def"
+
+  // Which conjunctions of each atomic feature to make:
+  unsigned int conj[NUMATOMICTEMPLATES];
+  for (int a=0; a<NUMATOMICTEMPLATES; a++)
+	conj[a] = on.conjunctions((AtomicTemplate)a);
+
+  // The atomic features:
+  int nAtomic = 0;
+  FeatureId atomicFeats[MAXATOMICS];
+  unsigned int atomicConj[MAXATOMICS];
+#define LINEAR_ATOMIC(a, name, lit, piece, lit2, piece2) \
+  if (conj[a] != 0) addAtomic(TEMPLATE_ID(lit, piece, lit2, piece2), conj[a], atomicFeats, atomicConj, nAtomic);
+#define LINEAR_NEIGHBOURS(a, name, left, right, dot, maxDist) \
+  if (conj[a] != 0) addNeighbourTags(pos, tags, sentSize, left, right, dot, maxDist, conj[a], \
+									 atomicFeats, atomicConj, nAtomic);
+#include "featureTemplates.def"
+
+  // Now make all their conjunctions:
+  for (int a=0; a<nAtomic; a++) {
+	FeatureId featId = atomicFeats[a];
+	unsigned int c = atomicConj[a];
+#define LINEAR_CONJUNCTION(c2, name, lit, piece) \
+	if (c & (1 << c2)) feats.push_back(ID_##piece(extendId(featId, lit)));
+#include "featureTemplates.def"
+  }
+
+  // And the bias term:
+#define LINEAR_BIAS(t, name, lit) \
+  if (on.has(t)) feats.push_back(extendId(EMPTY_ID, lit));
+#include "featureTemplates.def"
+}
+#undef ID_NOTHING
+#undef ID_WORD
+#undef ID_TAG
+#undef ID_PREFIX
+#undef ID_SUFFIX
+#undef ID_ANY_PREFIX
+#undef ID_ANY_SUFFIX
+#undef ID_SHAPE
+#undef ID_POSITION
+#undef ID_SIZE
+#undef ID_REVERSE
+#undef ID_REVERSE_BIN
+#undef ID_LEFT_WORD
+#undef ID_RIGHT_WORD
+#undef ID_LEFT_TAG
+#undef ID_RIGHT_TAG
+#undef ID_LEFT_TAG2
+#undef ID_RIGHT_TAG2
+#undef HAS_NOTHING
+#undef HAS_WORD
+#undef HAS_TAG
+#undef HAS_PREFIX
+#undef HAS_SUFFIX
+#undef HAS_SHAPE
+#undef TEMPLATE_ID
+
 // Build a feature vector given a pair of words and tags
 void buildQuadraticFeatureVector(int h, int m, const StrVec &words, const StrVec &tags, int sentSize, 
 								 const std::vector<float> &logPrecomputes, StrVec &binFeats, RealFeats &realFeats) {
@@ -260,16 +606,24 @@ void buildQuadraticFeatureVector(int h, int m, const StrVec &words, const StrVec
 }
   
 // Get the 0/1 predictions for each filter
-void getLinearFilterPredictions(const LinearWeightsMap &linWeights, const StrVec &feats, eightB &preds) {
+void getLinearFilterPredictions(const WeightTable &linWeights, const StrVec &feats, eightB &preds) {
+  // Packed rows are only summed by ID:
+  if (linWeights.encoding() != FLOAT_ROWS) {
+	FeatureIds ids;
+	for (StrVec::const_iterator itr=feats.begin(); itr != feats.end(); itr++)
+	  ids.push_back(featureId(*itr));
+	getLinearFilterPredictions(linWeights, ids, preds);
+	return;
+  }
   // Otherwise, build the eight scores for each filter type:
   float scores[8] = {0,0,0,0,0,0,0,0};  
   for (StrVec::const_iterator itr=feats.begin(); itr != feats.end(); itr++) {
 	// Get the weights for each feature:
-	LinearWeightsMap::const_iterator finder = linWeights.find(*itr);
+	const float *finder = linWeights.find(featureId(*itr));
 	// If there are weights for this feature:
-	if (finder != linWeights.end()) {
+	if (finder != NULL) {
 	  for (int i=0; i<8; i++) {
-		scores[i] += finder->second[i];
+		scores[i] += finder[i];
 	  }
 	}
   }
@@ -279,17 +633,33 @@ void getLinearFilterPredictions(const LinearWeightsMap &linWeights, const StrVec
   }
 }
   
+// The same, from the feature IDs:
+void getLinearFilterPredictions(const WeightTable &linWeights, const FeatureIds &feats, eightB &preds) {
+  unsigned int mask = getLinearFilterMask(linWeights, feats);
+  for (int i=0; i<8; i++) {
+	preds.push_back((mask >> i) & 1);
+  }
+}
+
 // Get the floating-point scores for each of the nine ultra filters:
-void getUltraLinearFilterScores(const LinearWeightsMap &linWeights, const StrVec &feats, eightF &preds) {
+void getUltraLinearFilterScores(const WeightTable &linWeights, const StrVec &feats, eightF &preds) {
+  // Packed rows are only summed by ID:
+  if (linWeights.encoding() != FLOAT_ROWS) {
+	FeatureIds ids;
+	for (StrVec::const_iterator itr=feats.begin(); itr != feats.end(); itr++)
+	  ids.push_back(featureId(*itr));
+	getUltraLinearFilterScores(linWeights, ids, preds);
+	return;
+  }
   // Build the eight scores for each filter type:
   float scores[8] = {0,0,0,0,0,0,0,0};  
   for (StrVec::const_iterator itr=feats.begin(); itr != feats.end(); itr++) {
     // Get the weights for each feature:
-    LinearWeightsMap::const_iterator finder = linWeights.find(*itr);
+    const float *finder = linWeights.find(featureId(*itr));
     // If there are weights for this feature:
-    if (finder != linWeights.end()) {
+    if (finder != NULL) {
       for (int i=0; i<8; i++) {
-		scores[i] += finder->second[i];
+		scores[i] += finder[i];
       }
     }
   }
@@ -299,30 +669,101 @@ void getUltraLinearFilterScores(const LinearWeightsMap &linWeights, const StrVec
   }
 }
 
-// Get the 0/1 prediction for the quadratic
-bool getQuadraticFilterPredictions(const QuadWeightMap &quadWeights, const StrVec &binFeats, const RealFeats &realFeats) {
+// The same, from the feature IDs:
+void getUltraLinearFilterScores(const WeightTable &linWeights, const FeatureIds &feats, eightF &preds) {
+  float scores[8];
+  sumLinearScores(linWeights, feats, scores);
+  for (int i=0; i<8; i++) {
+    preds.push_back(scores[i]);
+  }
+}
+
+// Make the per-token pieces of a sentence's quad features:
+void buildQuadFragments(const StrVec &words, const StrVec &tags, int sentSize, QuadFragments &frags) {
+  frags.wordIds.resize(sentSize);      frags.tagIds.resize(sentSize);
+  frags.headTagTilde.resize(sentSize); frags.headWordStar.resize(sentSize);
+  frags.modLeft.resize(sentSize);      frags.modRight.resize(sentSize);
+  frags.headLeft.resize(sentSize);     frags.headRight.resize(sentSize);
+  for (int i=0; i<sentSize; i++) {
+	frags.wordIds[i] = featureId(words[i]);
+	frags.tagIds[i] = featureId(tags[i]);
+	frags.headTagTilde[i] = extendId(frags.tagIds[i], '~');
+	frags.headWordStar[i] = extendId(frags.wordIds[i], '*');
+	const char *tagl = (i-1 > 0) ? tags[i-1].c_str() : "~";
+	const char *tagr = (i+1 < sentSize) ? tags[i+1].c_str() : "~";
+	frags.modLeft[i] = extendId(extendId(extendId(EMPTY_ID, 'l'), tagl), '.');
+	frags.modRight[i] = extendId(extendId(extendId(EMPTY_ID, 'n'), tagr), '.');
+	frags.headLeft[i] = extendId(extendId(extendId(EMPTY_ID, 'g'), tagl), '.');
+	frags.headRight[i] = extendId(extendId(extendId(EMPTY_ID, 'i'), tagr), '.');
+  }
+}
+
+// Count the distinct keys (tags or words) within WIDTH of either end of
+// the span between h and m, as buildQuadraticFeatureVector does, into a
+// flat array instead of a map.  The counts come out in the order the
+// map would iterate over them: a new tr1 map has BETWEENBUCKETS buckets
+// (too many to ever rehash here), walked in order, with the latest key
+// first within each.  So the scores add up in the very same order.
+int getBetweenCounts(int h, int m, const StrVec &keys, const FeatureIds &keyIds, BetweenCount *counts) {
+  int start = std::min(h, m);
+  int end = std::max(h, m);
+  int numKeys = 0;
+  for (int pass=0; pass<2; pass++) {
+	// First up from start, then down from end:
+	int from = (pass == 0) ? start+1 : end-1;
+	int to = (pass == 0) ? std::min(end-1, start+WIDTH) : std::max(start+1, std::max(end-WIDTH, start+WIDTH+1));
+	int step = (pass == 0) ? 1 : -1;
+	for (int i=from; (pass == 0) ? i<=to : i>=to; i+=step) {
+	  int k = 0;
+	  while (k < numKeys && !(keyIds[counts[k].token] == keyIds[i] && keys[counts[k].token] == keys[i]))
+		k++;
+	  if (k == numKeys) {
+		counts[numKeys].token = i;
+		counts[numKeys].count = 0;
+		numKeys++;
+	  }
+	  counts[k].count++;
+	}
+  }
+  // Into the map's order, by bucket, then latest first:
+  for (int k=0; k<numKeys; k++) counts[k].order = k;
+  for (int k=1; k<numKeys; k++) {
+	BetweenCount c = counts[k];
+	size_t bucket = keyIds[c.token] % BETWEENBUCKETS;
+	int j = k;
+	for (; j > 0; j--) {
+	  size_t prev = keyIds[counts[j-1].token] % BETWEENBUCKETS;
+	  if (prev < bucket || (prev == bucket && counts[j-1].order > c.order)) break;
+	  counts[j] = counts[j-1];
+	}
+	counts[j] = c;
+  }
+  return numKeys;
+}
+
+bool getQuadraticFilterPredictions(const WeightTable &quadWeights, const StrVec &binFeats, const RealFeats &realFeats) {
   float score = 0;
   for (StrVec::const_iterator itr=binFeats.begin(); itr != binFeats.end(); itr++) {
 	// Get the weights for each feature:
-	QuadWeightMap::const_iterator finder = quadWeights.find(*itr);
+	const float *finder = quadWeights.find(featureId(*itr));
 	// If there are weights for this feature:
-	if (finder != quadWeights.end()) {
-	  score += finder->second;
+	if (finder != NULL) {
+	  score += *finder;
 	}
   }
   for (RealFeats::const_iterator itr=realFeats.begin(); itr != realFeats.end(); itr++) {
 	// Get the weights for each feature:
-	QuadWeightMap::const_iterator finder = quadWeights.find(itr->first);
+	const float *finder = quadWeights.find(featureId(itr->first));
 	// If there are weights for this feature:
-	if (finder != quadWeights.end()) {
-	  score += finder->second * itr->second;
+	if (finder != NULL) {
+	  score += *finder * itr->second;
 	}
   }
-  return (score > 0.00000001);
+  return (score > QUAD_THRESHOLD);
 }
 
 // Load the weight matrix from file:
-void initializeLinearWeights(char *filename, LinearWeightsMap &linWeights) {
+void initializeLinearWeights(const char *filename, LinearWeightsMap &linWeights, FeatureNames *names) {
   std::cerr << "Loading linear weights ";
   // We pass zero for blank weight files, so load nothing:
   if (filename[0] == '0') return;
@@ -336,6 +777,10 @@ void initializeLinearWeights(char *filename, LinearWeightsMap &linWeights) {
 
   // parse each input line:
   std::string feat;
+  // Just to make sure no two features share an ID (and, if asked, to
+  // keep their names):
+  FeatureNames ownNames;
+  FeatureNames &featNames = (names != NULL) ? *names : ownNames;
   while (file >> feat) {
     // Read in the eight weights for this feature
 	eightF wtset;
@@ -343,8 +788,15 @@ void initializeLinearWeights(char *filename, LinearWeightsMap &linWeights) {
     for (int i=0; i<8; i++) {
       file >> wt; wtset.push_back(wt);
     }
-    // Add to the weight matrix:
-    linWeights[feat] = wtset;
+    // Add to the weight matrix, under the feature's ID:
+    FeatureId id = featureId(feat);
+    std::string &name = featNames[id];
+    if (name != "" && name != feat) {
+      std::cerr << "Error! Features " << name << " and " << feat << " have the same ID" << std::endl;
+      exit(-1);
+    }
+    name = feat;
+    linWeights[id] = wtset;
   }
   
   // close the file
@@ -353,7 +805,7 @@ void initializeLinearWeights(char *filename, LinearWeightsMap &linWeights) {
 }
 
 // Load the ultra 2-d pair matrix from file:
-void initializeUltraPairWeights(char *filename, UltraPairWeightsMap &pairWeights) {
+void initializeUltraPairWeights(const char *filename, UltraPairWeightsMap &pairWeights) {
   std::cerr << "Loading ultra-pair weights ";
   // We pass zero for blank weight files, so load nothing:
   if (filename[0] == '0') return;
@@ -383,7 +835,7 @@ void initializeUltraPairWeights(char *filename, UltraPairWeightsMap &pairWeights
 }
 
 // Load the weight vector from file:
-void initializeQuadWeights(char *filename, QuadWeightMap &quadWeights) {
+void initializeQuadWeights(const char *filename, QuadWeightMap &quadWeights) {
   std::cerr << "Loading quadratic weights ";
   // We pass zero for blank weight files, so load nothing:
   if (filename[0] == '0') return;
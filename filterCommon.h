@@ -19,7 +19,11 @@
 #include <vector>
 #include <bitset>     // For filtering decisions, FilterVals type
 
+#include "featureTemplates.h"
+
 const int MAXSENTSIZE = 999;  // For the efficient bitvector, and for int2str
+const int WIDTH = 5;         // For the scope of between-tag finding in quadratic
+const double QUAD_THRESHOLD = 0.00000001;  // For the quadratic filter to keep an arc
 
 typedef std::tr1::unordered_set<std::string> RuleLists;
 typedef std::vector<std::string> StrVec;
@@ -35,23 +39,91 @@ typedef std::vector<float> eightF;
 // For the two pair filters:
 typedef std::vector<float> twoW;
 
-typedef std::tr1::unordered_map<std::string,eightF> LinearWeightsMap;
+// Linear features are identified by 64-bit IDs: the same FNV-1a hash
+// that std::tr1::hash gives their strings, but built up piece by
+// piece, so that the feature strings never need to be made:
+typedef size_t FeatureId;
+typedef std::vector<FeatureId> FeatureIds;
+
+typedef std::tr1::unordered_map<FeatureId,eightF> LinearWeightsMap;
+typedef std::tr1::unordered_map<FeatureId,std::string> FeatureNames;
 typedef std::tr1::unordered_map<std::string,twoW> UltraPairWeightsMap;
 typedef std::tr1::unordered_map<std::string,float> QuadWeightMap;
 typedef std::vector< std::pair<std::string,float> > RealFeats;
 
+// For interning tags as small integers:
+typedef std::tr1::unordered_map<std::string,int> TagIndex;
+const int MAXTAGS = 64;  // The most tags a tag set may hold
+
+// All the weights, once loaded, are looked up in one of these:
+class WeightTable;
+
 // Load in all the rules for simple filtering of arcs
 void initializeTaboos(RuleLists& tabooHeads, RuleLists& noLeftHead, RuleLists& noRightHead, RuleLists& tabooPairs);
 
+// Load in the tag set (after normLines) that tags are interned from,
+// numbering them 0, 1, 2...:
+void initializeTagSet(TagIndex& tagSet);
+
 // Quickly turn an integer into a string: For efficiency: Use fact we
 // never have a distance or index > 999
 // Whoops : you need another byte for the '\0' guy that terminates strings!
+// (The buffer is local, not static, so that threads can share this.)
 inline std::string fastInt2Str(int d) {
-  static char buf[4];
+  char buf[12];
   sprintf(buf, "%d", d);
   return buf;
 }
 
+// The ID of the empty string, i.e. where every feature ID starts:
+const FeatureId EMPTY_ID = static_cast<FeatureId>(14695981039346656037ULL);
+
+// Add one character to the end of a feature ID:
+inline FeatureId extendId(FeatureId id, char c) {
+  id ^= static_cast<FeatureId>(c);
+  return id * static_cast<FeatureId>(1099511628211ULL);
+}
+
+// Add len characters to the end of a feature ID:
+inline FeatureId extendId(FeatureId id, const char *s, int len) {
+  for (int i=0; i<len; i++)
+	id = extendId(id, s[i]);
+  return id;
+}
+
+inline FeatureId extendId(FeatureId id, const char *s) {
+  for (; *s; s++)
+	id = extendId(id, *s);
+  return id;
+}
+
+inline FeatureId extendId(FeatureId id, const std::string &s) {
+  return extendId(id, s.data(), s.size());
+}
+
+// Add an integer, written out as fastInt2Str would, to a feature ID:
+inline FeatureId extendIdNum(FeatureId id, int d) {
+  char buf[12];
+  int len = 0;
+  unsigned int u = d;
+  if (d < 0) {
+	id = extendId(id, '-');
+	u = -u;
+  }
+  do {
+	buf[len++] = '0' + u % 10;
+	u /= 10;
+  } while (u);
+  while (len)
+	id = extendId(id, buf[--len]);
+  return id;
+}
+
+// The ID of a complete feature string:
+inline FeatureId featureId(const std::string &feat) {
+  return extendId(EMPTY_ID, feat);
+}
+
 // Preprocess the input lines as I did when training:
 inline void normLines(std::string &input) {
   for (std::string::iterator cItr=input.begin(); cItr != input.end(); cItr++) {
@@ -69,6 +141,17 @@ inline void normWords(std::string &input) {
 	  *cItr = '0';
 }
 
+// Read a preprocessed line of word_tag_head triples into the word and
+// tag arrays:
+void readSentence(const std::string &input, StrVec &words, StrVec &tags);
+
+// The same for a raw line, doing the normLines and normWords
+// preprocessing in the same single pass, in place.  The arrays are
+// overwritten, reusing their strings from the last sentence.  If heads
+// isn't NULL, it gets each token's gold head, or -1 where that isn't a
+// number (e.g. "*").
+void readSentence(char *line, int len, StrVec &words, StrVec &tags, std::vector<int> *heads = NULL);
+
 inline void safeNeighbourDoubleGet(int nbh, const StrVec &words, const StrVec &tags, int sentSize,
 								   std::string *wordNbh, std::string *tagNbh) {
   if (nbh > 0 && nbh < sentSize) {
@@ -98,26 +181,63 @@ inline std::string binDistance(int d);
 // Build a feature vector given the current words and tags:
 void buildLinearFeatureVector(int pos, const StrVec &words, const StrVec &tags, int sentSize, StrVec &feats);
 
+// The same features as IDs, in the same order, leaving out those of
+// any templates not in the mask:
+void buildLinearFeatureIds(int pos, const StrVec &words, const StrVec &tags, int sentSize, FeatureIds &feats,
+						   const TemplateMask *templates = NULL);
+
 // Build a feature vector given a pair of words and tags
 void buildQuadraticFeatureVector(int h, int m, const StrVec &words, const StrVec &tags, int sentSize, 
 								 const std::vector<float> &logPrecomputes, StrVec &binfeats, RealFeats &realfeats);
 
+// The per-token pieces of a sentence's quad features, made once per
+// sentence, so that each arc's features can be built up as IDs from
+// them without making any strings:
+struct QuadFragments {
+  FeatureIds wordIds, tagIds;         // Each word and tag on its own
+  FeatureIds headTagTilde;            // th + "~"
+  FeatureIds headWordStar;            // wh + "*"
+  FeatureIds modLeft, modRight;       // "l" + tml + ".", "n" + tmr + "."
+  FeatureIds headLeft, headRight;     // "g" + thl + ".", "i" + thr + "."
+};
+
+void buildQuadFragments(const StrVec &words, const StrVec &tags, int sentSize, QuadFragments &frags);
+
+// How often a key (tag or word) occurs between a head and mod:
+struct BetweenCount {
+  int token;   // Where it first occurs
+  int count;
+  int order;   // Scratch, for the sort
+};
+
+// Buckets in a new tr1 unordered_map:
+const int BETWEENBUCKETS = 11;
+
+// Count the keys between h and m, as buildQuadraticFeatureVector does,
+// in the order it would add their weights.  counts needs room for
+// 2*WIDTH of them:
+int getBetweenCounts(int h, int m, const StrVec &keys, const FeatureIds &keyIds, BetweenCount *counts);
+
 // Get the 0/1 predictions for each filter
-void getLinearFilterPredictions(const LinearWeightsMap &linWeights, const StrVec &feats, eightB &preds);
+void getLinearFilterPredictions(const WeightTable &linWeights, const StrVec &feats, eightB &preds);
+
+void getLinearFilterPredictions(const WeightTable &linWeights, const FeatureIds &feats, eightB &preds);
 
 // Get the floating-point scores for each of the nine ultra filters:
-void getUltraLinearFilterScores(const LinearWeightsMap &linWeights, const StrVec &feats, eightF &preds);
+void getUltraLinearFilterScores(const WeightTable &linWeights, const StrVec &feats, eightF &preds);
+void getUltraLinearFilterScores(const WeightTable &linWeights, const FeatureIds &feats, eightF &preds);
 
 // Get the 0/1 prediction for the quadratic
-bool getQuadraticFilterPredictions(const QuadWeightMap &quadWeights, const StrVec &binFeats, const RealFeats &realFeats);
+bool getQuadraticFilterPredictions(const WeightTable &quadWeights, const StrVec &binFeats, const RealFeats &realFeats);
 
-// Load the weight matrix from file:
-void initializeLinearWeights(char *filename, LinearWeightsMap &linWeights);
+// Load the weight matrix from file, and, if asked, the name of each
+// feature:
+void initializeLinearWeights(const char *filename, LinearWeightsMap &linWeights, FeatureNames *names = NULL);
 
 // Load the ultra 2-D pair weight matrix from file:
-void initializeUltraPairWeights(char *filename, UltraPairWeightsMap &pairWeights);
+void initializeUltraPairWeights(const char *filename, UltraPairWeightsMap &pairWeights);
 
 // Load the weight vector from file:
-void initializeQuadWeights(char *filename, QuadWeightMap &quadWeights);
+void initializeQuadWeights(const char *filename, QuadWeightMap &quadWeights);
 
 #endif // FILTERCOMMON_H
@@ -0,0 +1,169 @@
+/******************************************
+ *
+ * filterStats.cpp
+ *
+ ******************************************/
+
+#include "filterStats.h"
+
+#include <time.h>     // For clock_gettime
+#include <stdio.h>    // For rename
+#include <stdlib.h>   // For exit
+#include <iostream>   // For errors
+#include <fstream>    // For the stats file
+#include <string>
+
+static const char *PRUNE_NAMES[NUMPRUNEREASONS] = {
+  "head", "Lx", "Rx", "L1", "R1", "L5", "R5",
+  "root_crossing", "root_taken", "taboo_pair", "quad_score", "pair_score", "head_limit"
+};
+
+static const char *STAGE_NAMES[NUMSTAGES] = {
+  "parse", "linear", "arcs", "quad", "output"
+};
+
+static const char *CASCADE_NAMES[NUMCASCADESTAGES] = {
+  "roles", "roots", "taboo", "quad", "pair"
+};
+
+const char *cascadeStageName(int stage) {
+  return CASCADE_NAMES[stage];
+}
+
+uint64_t statsClock() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void FilterStats::clear() {
+  sentences = unfitSentences = tokens = arcsConsidered = arcsKept = arcsRestored = 0;
+  for (int r=0; r<NUMPRUNEREASONS; r++) pruned[r] = 0;
+  for (int s=0; s<NUMSTAGES; s++) stageNs[s] = 0;
+  for (int b=0; b<LATENCYBUCKETS; b++) latency[b] = 0;
+  connections = 0;
+  for (int b=0; b<LATENCYBUCKETS; b++) requestLatency[b] = 0;
+  for (int s=0; s<NUMCASCADESTAGES; s++) cascadeArcs[s] = cascadeKept[s] = cascadeNs[s] = 0;
+}
+
+void FilterStats::add(const FilterStats &other) {
+  sentences += other.sentences;
+  unfitSentences += other.unfitSentences;
+  tokens += other.tokens;
+  arcsConsidered += other.arcsConsidered;
+  arcsKept += other.arcsKept;
+  arcsRestored += other.arcsRestored;
+  for (int r=0; r<NUMPRUNEREASONS; r++) pruned[r] += other.pruned[r];
+  for (int s=0; s<NUMSTAGES; s++) stageNs[s] += other.stageNs[s];
+  for (int b=0; b<LATENCYBUCKETS; b++) latency[b] += other.latency[b];
+  connections += other.connections;
+  for (int b=0; b<LATENCYBUCKETS; b++) requestLatency[b] += other.requestLatency[b];
+  for (int s=0; s<NUMCASCADESTAGES; s++) {
+	cascadeArcs[s] += other.cascadeArcs[s];
+	cascadeKept[s] += other.cascadeKept[s];
+	cascadeNs[s] += other.cascadeNs[s];
+  }
+}
+
+// Bucket b > 0 holds latencies of [2^(b-1), 2^b) microseconds:
+static int latencyBucket(uint64_t ns) {
+  uint64_t us = ns / 1000;
+  int b = 0;
+  while (us > 0 && b < LATENCYBUCKETS-1) {
+	us >>= 1;
+	b++;
+  }
+  return b;
+}
+
+void FilterStats::addLatency(uint64_t ns) {
+  latency[latencyBucket(ns)]++;
+}
+
+void FilterStats::addRequestLatency(uint64_t ns) {
+  requestLatency[latencyBucket(ns)]++;
+}
+
+// A latency histogram, as the object under name:
+static void writeHistogram(std::ostream &out, const char *name, const uint64_t *counts) {
+  // The last bucket has no upper bound:
+  out << "  \"" << name << "\": {\n";
+  out << "    \"upper_bounds\": [";
+  for (int b=0; b<LATENCYBUCKETS; b++) {
+	out << (b ? ", " : "");
+	if (b < LATENCYBUCKETS-1) out << ((uint64_t)1 << b);
+	else out << "null";
+  }
+  out << "],\n";
+  out << "    \"counts\": [";
+  for (int b=0; b<LATENCYBUCKETS; b++)
+	out << (b ? ", " : "") << counts[b];
+  out << "]\n";
+  out << "  }";
+}
+
+void FilterStats::writeJson(std::ostream &out) const {
+  out << "{\n";
+  out << "  \"sentences\": " << sentences << ",\n";
+  out << "  \"unfit_sentences\": " << unfitSentences << ",\n";
+  out << "  \"tokens\": " << tokens << ",\n";
+  out << "  \"arcs\": {\n";
+  out << "    \"considered\": " << arcsConsidered << ",\n";
+  out << "    \"kept\": " << arcsKept << ",\n";
+  out << "    \"restored\": " << arcsRestored << ",\n";
+  out << "    \"pruned\": {";
+  for (int r=0; r<NUMPRUNEREASONS; r++)
+	out << (r ? ", " : " ") << "\"" << PRUNE_NAMES[r] << "\": " << pruned[r];
+  out << " }\n";
+  out << "  },\n";
+  out << "  \"stage_seconds\": {";
+  for (int s=0; s<NUMSTAGES; s++)
+	out << (s ? ", " : " ") << "\"" << STAGE_NAMES[s] << "\": " << stageNs[s] / 1e9;
+  out << " },\n";
+  writeHistogram(out, "latency_us", latency);
+  // Only a server has these:
+  if (connections > 0) {
+	out << ",\n";
+	out << "  \"connections\": " << connections << ",\n";
+	writeHistogram(out, "request_latency_us", requestLatency);
+  }
+  // Only a cascade has these, for the stages it ran:
+  bool first = true;
+  for (int s=0; s<NUMCASCADESTAGES; s++) {
+	if (cascadeArcs[s] == 0 && cascadeNs[s] == 0) continue;
+	out << (first ? ",\n  \"cascade\": {\n" : ",\n");
+	first = false;
+	out << "    \"" << CASCADE_NAMES[s] << "\": { \"arcs\": " << cascadeArcs[s]
+		<< ", \"kept\": " << cascadeKept[s]
+		<< ", \"survival\": " << (cascadeArcs[s] > 0 ? (double)cascadeKept[s] / cascadeArcs[s] : 1)
+		<< ", \"seconds\": " << cascadeNs[s] / 1e9 << " }";
+  }
+  if (!first)
+	out << "\n  }";
+  out << "\n";
+  out << "}\n";
+}
+
+void FilterStats::saveEvery(const char *filename, double interval, uint64_t &lastSave) const {
+  if (interval <= 0) return;
+  uint64_t now = statsClock();
+  if (now - lastSave >= interval * 1e9) {
+	save(filename);
+	lastSave = now;
+  }
+}
+
+void FilterStats::save(const char *filename) const {
+  std::string temp = std::string(filename) + ".tmp";
+  std::ofstream file(temp.c_str());
+  if (!file) {
+	std::cerr << "Error! Stats file " << temp << " can not be opened" << std::endl;
+	exit(-1);
+  }
+  writeJson(file);
+  file.close();
+  if (!file || rename(temp.c_str(), filename) != 0) {
+	std::cerr << "Error! Could not write stats file " << filename << std::endl;
+	exit(-1);
+  }
+}
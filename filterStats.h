@@ -0,0 +1,102 @@
+/******************************************
+ *
+ * filterStats.h
+ *
+ * Counters kept while filtering, if asked for: how many arcs each
+ * filter pruned, the time spent in each stage, and a histogram of the
+ * time taken per sentence.  A server also keeps a histogram of each
+ * sentence's time from being read off its socket to being written
+ * back, and a cascade counts the arcs that survive each of its stages.
+ * Each thread keeps its own, and they're added up for writing
+ * out as JSON.
+ *
+ ******************************************/
+
+#ifndef FILTERSTATS_H
+#define FILTERSTATS_H
+
+#include <stdint.h>
+#include <ostream>
+
+// Why an arc was pruned.  Each arc is put down to the first test that
+// rules it out, in the order the engines make them:
+enum PruneReason {
+  PRUNE_HEAD,           // The head can't be a head (taboo, or the head filter)
+  PRUNE_LX, PRUNE_RX,   // The mod has no heads to the left/right
+  PRUNE_L1, PRUNE_R1,   // The mod's head is the next token left/right
+  PRUNE_L5, PRUNE_R5,   // The mod's head is within 5 tokens left/right
+  PRUNE_ROOT_CROSSING,  // The arc would cross a predicted root
+  PRUNE_ROOT_TAKEN,     // An arc from the root, when another token is the root
+  PRUNE_TABOO_PAIR,     // The head and mod tags are a taboo pair
+  PRUNE_QUAD_SCORE,     // The quad filter's score
+  PRUNE_PAIR_SCORE,     // The ultra filter's pair score
+  PRUNE_HEAD_LIMIT,     // Outside the mod's top k heads, or too far below the best
+  NUMPRUNEREASONS
+};
+
+// The stages each sentence goes through:
+enum FilterStage {
+  PARSE_STAGE,    // Normalizing and splitting the input line
+  LINEAR_STAGE,   // The token-role features, weights and filters
+  ARC_STAGE,      // Going through the head-mod pairs
+  QUAD_STAGE,     // Scoring the survivors with the quad filter
+  OUTPUT_STAGE,   // Writing out the decisions
+  NUMSTAGES
+};
+
+// The stages a cascade (see FilterCascade) can run over the arcs, in
+// any order, each seeing only the arcs the ones before it kept:
+enum CascadeStage {
+  CASCADE_ROLES,   // The token-role filters: head, Lx, Rx, L1, R1, L5, R5
+  CASCADE_ROOTS,   // Crossing a predicted root, or taking the root's place
+  CASCADE_TABOO,   // The taboo pairs of tags
+  CASCADE_QUAD,    // The quad filter's score
+  CASCADE_PAIR,    // The ultra filter's pair score
+  NUMCASCADESTAGES
+};
+// Their names, as in cascade configs and the stats:
+const char *cascadeStageName(int stage);
+
+// The latency histogram's buckets: the first is for sentences filtered
+// in under 1 microsecond, then each doubles, and the last takes the rest:
+const int LATENCYBUCKETS = 24;
+
+// Nanoseconds on a monotonic clock:
+uint64_t statsClock();
+
+struct FilterStats {
+  uint64_t sentences;       // Sentences filtered
+  uint64_t unfitSentences;  // And ones too long to filter
+  uint64_t tokens;          // In the filtered ones, not counting the roots
+  uint64_t arcsConsidered;  // Every head for every mod, bar itself
+  uint64_t arcsKept;
+  uint64_t arcsRestored;    // Pruned, but given back as a mod's only head
+  uint64_t pruned[NUMPRUNEREASONS];
+  uint64_t stageNs[NUMSTAGES];
+  uint64_t latency[LATENCYBUCKETS];
+  uint64_t connections;     // Served, if this is a server
+  uint64_t requestLatency[LATENCYBUCKETS];
+  // For a cascade, the arcs each stage was given and kept, and its time:
+  uint64_t cascadeArcs[NUMCASCADESTAGES];
+  uint64_t cascadeKept[NUMCASCADESTAGES];
+  uint64_t cascadeNs[NUMCASCADESTAGES];
+
+  FilterStats() { clear(); }
+  void clear();
+  // Add in another thread's counts:
+  void add(const FilterStats &other);
+  // Count one sentence's time to filter:
+  void addLatency(uint64_t ns);
+  // And a server's time to answer it:
+  void addRequestLatency(uint64_t ns);
+
+  void writeJson(std::ostream &out) const;
+  // Write the JSON to a file, replacing it all at once so that a
+  // reader never sees half of it:
+  void save(const char *filename) const;
+  // Save them if it's been interval seconds (if that's > 0) since they
+  // were last saved, at lastSave:
+  void saveEvery(const char *filename, double interval, uint64_t &lastSave) const;
+};
+
+#endif // FILTERSTATS_H
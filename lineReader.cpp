@@ -0,0 +1,55 @@
+/******************************************
+ *
+ * lineReader.cpp
+ *
+ ******************************************/
+
+#include "lineReader.h"
+
+#include <string.h>   // For memchr, memmove
+
+LineReader::LineReader(std::istream &input, int bufferSize)
+  : in(input), buf(bufferSize), start(0), end(0), eof(false) {
+}
+
+// Move any partial line to the front, and read in more after it:
+bool LineReader::refill() {
+  if (eof) return false;
+  if (start > 0) {
+	memmove(&buf[0], &buf[start], end - start);
+	end -= start;
+	start = 0;
+  }
+  // A line longer than the buffer: make room for it
+  if (end == (int)(buf.size()))
+	buf.resize(buf.size() * 2);
+  in.read(&buf[end], buf.size() - end);
+  int got = in.gcount();
+  end += got;
+  if (got == 0)
+	eof = true;
+  return got > 0;
+}
+
+// The next line, without its '\n':
+bool LineReader::nextLine(char *&line, int &len) {
+  for (;;) {
+	char *newline = (char *)memchr(&buf[0] + start, '\n', end - start);
+	if (newline != NULL) {
+	  line = &buf[0] + start;
+	  len = newline - line;
+	  start += len + 1;
+	  return true;
+	}
+	if (!refill()) {
+	  // The last line, if it had no '\n':
+	  if (end > start) {
+		line = &buf[0] + start;
+		len = end - start;
+		start = end;
+		return true;
+	  }
+	  return false;
+	}
+  }
+}
@@ -0,0 +1,36 @@
+/******************************************
+ *
+ * lineReader.h
+ *
+ * Reading input lines out of one large buffer, rather than a string
+ * per line: each line is handed back in place, and can be modified
+ * there (e.g. normalized) until the next one is read.
+ *
+ ******************************************/
+
+#ifndef LINEREADER_H
+#define LINEREADER_H
+
+#include <istream>
+#include <vector>
+
+class LineReader {
+ public:
+  LineReader(std::istream &in, int bufferSize = 1 << 20);
+
+  // The next line, without its '\n'.  Like getline, the last line
+  // needs no '\n' of its own.  Returns false at the end of the input.
+  bool nextLine(char *&line, int &len);
+
+ private:
+  // Move any partial line to the front, and read in more after it:
+  bool refill();
+
+  std::istream &in;
+  std::vector<char> buf;
+  int start;   // Where the next line starts
+  int end;     // The end of what's been read
+  bool eof;
+};
+
+#endif // LINEREADER_H
@@ -0,0 +1,175 @@
+/******************************************
+ *
+ * scoreKernel.cpp
+ *
+ ******************************************/
+
+#include "scoreKernel.h"
+#include "weightTable.h"
+
+#include <string.h>     // For strcmp
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>  // For the SSE and AVX intrinsics
+#endif
+
+////////////////////////////////////////////////
+// Plain C:
+////////////////////////////////////////////////
+static void sumScalar(const WeightTable &linWeights, const FeatureIds &feats, float scores[8]) {
+  for (int i=0; i<8; i++) scores[i] = 0;
+  for (FeatureIds::const_iterator itr=feats.begin(); itr != feats.end(); itr++) {
+	const float *row = linWeights.find(*itr);
+	if (row != NULL)
+	  for (int i=0; i<8; i++)
+		scores[i] += row[i];
+  }
+}
+
+static unsigned int maskScalar(const WeightTable &linWeights, const FeatureIds &feats) {
+  float scores[8];
+  sumScalar(linWeights, feats, scores);
+  unsigned int mask = 0;
+  for (int i=0; i<8; i++)
+	if (scores[i] > LINEAR_THRESHOLD) mask |= 1 << i;
+  return mask;
+}
+
+////////////////////////////////////////////////
+// Packed rows: only the nonzero lanes are stored, so there's nothing to
+// vectorize.  The int8s are summed exactly and scaled once at the end.
+////////////////////////////////////////////////
+static void sumPacked(const WeightTable &linWeights, const FeatureIds &feats, float scores[8]) {
+  if (linWeights.encoding() == INT8_ROWS) {
+	int sums[8] = { 0 };
+	for (FeatureIds::const_iterator itr=feats.begin(); itr != feats.end(); itr++) {
+	  const uint8_t *row = linWeights.findPacked(*itr);
+	  if (row == NULL) continue;
+	  const int8_t *q = (const int8_t *)(row + 1);
+	  for (unsigned int lanes = row[0]; lanes != 0; lanes &= lanes - 1)
+		sums[__builtin_ctz(lanes)] += *q++;
+	}
+	const float *scales = linWeights.laneScales();
+	for (int i=0; i<8; i++)
+	  scores[i] = sums[i] * scales[i];
+  } else {
+	for (int i=0; i<8; i++) scores[i] = 0;
+	for (FeatureIds::const_iterator itr=feats.begin(); itr != feats.end(); itr++) {
+	  const uint8_t *row = linWeights.findPacked(*itr);
+	  if (row == NULL) continue;
+	  const uint8_t *h = row + 1;
+	  for (unsigned int lanes = row[0]; lanes != 0; lanes &= lanes - 1, h += 2)
+		scores[__builtin_ctz(lanes)] += halfToFloat(h[0] | (h[1] << 8));
+	}
+  }
+}
+
+#ifdef HAVE_X86_KERNELS
+////////////////////////////////////////////////
+// SSE: the eight lanes as two halves:
+////////////////////////////////////////////////
+static inline void sumSSE(const WeightTable &linWeights, const FeatureIds &feats, __m128 &lo, __m128 &hi) {
+  lo = _mm_setzero_ps();
+  hi = _mm_setzero_ps();
+  for (FeatureIds::const_iterator itr=feats.begin(); itr != feats.end(); itr++) {
+	const float *row = linWeights.find(*itr);
+	if (row != NULL) {
+	  // Rows are 32-byte aligned (see weightTable.h):
+	  lo = _mm_add_ps(lo, _mm_load_ps(row));
+	  hi = _mm_add_ps(hi, _mm_load_ps(row + 4));
+	}
+  }
+}
+
+static void sumScoresSSE(const WeightTable &linWeights, const FeatureIds &feats, float scores[8]) {
+  __m128 lo, hi;
+  sumSSE(linWeights, feats, lo, hi);
+  _mm_storeu_ps(scores, lo);
+  _mm_storeu_ps(scores + 4, hi);
+}
+
+static unsigned int maskSSE(const WeightTable &linWeights, const FeatureIds &feats) {
+  __m128 lo, hi;
+  sumSSE(linWeights, feats, lo, hi);
+  __m128 t = _mm_set1_ps(LINEAR_THRESHOLD);
+  return _mm_movemask_ps(_mm_cmpgt_ps(lo, t)) | (_mm_movemask_ps(_mm_cmpgt_ps(hi, t)) << 4);
+}
+
+////////////////////////////////////////////////
+// AVX: all eight lanes in one register:
+////////////////////////////////////////////////
+__attribute__((target("avx")))
+static inline __m256 sumAVX(const WeightTable &linWeights, const FeatureIds &feats) {
+  __m256 acc = _mm256_setzero_ps();
+  for (FeatureIds::const_iterator itr=feats.begin(); itr != feats.end(); itr++) {
+	const float *row = linWeights.find(*itr);
+	if (row != NULL)
+	  acc = _mm256_add_ps(acc, _mm256_load_ps(row));
+  }
+  return acc;
+}
+
+__attribute__((target("avx")))
+static void sumScoresAVX(const WeightTable &linWeights, const FeatureIds &feats, float scores[8]) {
+  _mm256_storeu_ps(scores, sumAVX(linWeights, feats));
+}
+
+__attribute__((target("avx")))
+static unsigned int maskAVX(const WeightTable &linWeights, const FeatureIds &feats) {
+  __m256 acc = sumAVX(linWeights, feats);
+  return _mm256_movemask_ps(_mm256_cmp_ps(acc, _mm256_set1_ps(LINEAR_THRESHOLD), _CMP_GT_OQ));
+}
+#endif // HAVE_X86_KERNELS
+
+////////////////////////////////////////////////
+// Picking one, once:
+////////////////////////////////////////////////
+struct ScoreKernel {
+  const char *name;
+  void (*sum)(const WeightTable &, const FeatureIds &, float *);
+  unsigned int (*mask)(const WeightTable &, const FeatureIds &);
+};
+
+static ScoreKernel chooseKernel() {
+  ScoreKernel scalar = { "scalar", sumScalar, maskScalar };
+  const char *forced = getenv("ARCFILTER_KERNEL");
+  if (forced != NULL && strcmp(forced, "scalar") == 0) return scalar;
+#ifdef HAVE_X86_KERNELS
+  ScoreKernel sse = { "sse", sumScoresSSE, maskSSE };
+  ScoreKernel avx = { "avx", sumScoresAVX, maskAVX };
+
+  __builtin_cpu_init();  // We may run before the other constructors
+  bool hasAVX = __builtin_cpu_supports("avx");
+  bool hasSSE = __builtin_cpu_supports("sse2");
+
+  if (forced != NULL && strcmp(forced, "sse") == 0 && hasSSE) return sse;
+  if (hasAVX) return avx;
+  if (hasSSE) return sse;
+#endif
+  return scalar;
+}
+
+static const ScoreKernel kernel = chooseKernel();
+
+void sumLinearScores(const WeightTable &linWeights, const FeatureIds &feats, float scores[8]) {
+  if (linWeights.encoding() != FLOAT_ROWS)
+	sumPacked(linWeights, feats, scores);
+  else
+	kernel.sum(linWeights, feats, scores);
+}
+
+unsigned int getLinearFilterMask(const WeightTable &linWeights, const FeatureIds &feats) {
+  if (linWeights.encoding() == FLOAT_ROWS)
+	return kernel.mask(linWeights, feats);
+  float scores[8];
+  sumPacked(linWeights, feats, scores);
+  unsigned int mask = 0;
+  for (int i=0; i<8; i++)
+	if (scores[i] > LINEAR_THRESHOLD) mask |= 1 << i;
+  return mask;
+}
+
+const char *scoreKernelName() {
+  return kernel.name;
+}
@@ -0,0 +1,41 @@
+/******************************************
+ *
+ * scoreKernel.h
+ *
+ * Summing the eight linear filter scores over a token's features, with
+ * the version (AVX, SSE or plain C) picked once for the running CPU.
+ * Each lane is summed in the same order in every version, so they all
+ * give bit-identical scores.
+ *
+ ******************************************/
+
+#ifndef SCOREKERNEL_H
+#define SCOREKERNEL_H
+
+#include "filterCommon.h"
+
+// The eight linear filters, in the order of their weights:
+enum LinearFilter { HEAD_FILTER, ROOT_FILTER, LX_FILTER, L1_FILTER, L5_FILTER, RX_FILTER, R1_FILTER, R5_FILTER };
+
+// The threshold for a filter to fire.  No float lies strictly between
+// it and the double 0.000001, so comparing in float gives the same
+// decisions as the original double comparison.
+const float LINEAR_THRESHOLD = 0.000001f;
+
+// Bit f of a mask is set when filter f fires:
+inline bool firesFilter(unsigned int mask, LinearFilter f) {
+  return (mask >> f) & 1;
+}
+
+// Sum the weights of the features into the eight scores:
+void sumLinearScores(const WeightTable &linWeights, const FeatureIds &feats, float scores[8]);
+
+// Sum them, and return which of the scores are > LINEAR_THRESHOLD:
+unsigned int getLinearFilterMask(const WeightTable &linWeights, const FeatureIds &feats);
+
+// Which version is in use ("avx", "sse" or "scalar").  Setting the
+// environment variable ARCFILTER_KERNEL to one of these names forces
+// that version, if the CPU has it.
+const char *scoreKernelName();
+
+#endif // SCOREKERNEL_H
@@ -0,0 +1,388 @@
+/******************************************
+ *
+ * weightTable.cpp
+ *
+ ******************************************/
+
+#include "weightTable.h"
+
+#include <string.h>     // For memcmp, memcpy, memset
+#include <math.h>       // For fabs, lrintf
+#include <fcntl.h>      // For open
+#include <unistd.h>     // For close
+#include <sys/mman.h>   // For mmap
+#include <sys/stat.h>   // For the file size
+
+#include <iostream>     // For errors and progress
+#include <fstream>      // For writing images
+
+static const char MODEL_MAGIC[8] = { 'A','R','C','F','M','O','D','L' };
+
+// Round up to a multiple of a cache line:
+static inline uint64_t lineAlign(uint64_t offset) {
+  return (offset + 63) & ~(uint64_t)63;
+}
+
+WeightTable::WeightTable()
+  : image(NULL), imageSize(0), mapped(false),
+    header(NULL), slots(NULL), rows(NULL), packedRows(NULL),
+    numSlots(0), numRows(0), width(0), rowEncoding(FLOAT_ROWS) {
+}
+
+WeightTable::~WeightTable() {
+  release();
+}
+
+void WeightTable::release() {
+  if (image != NULL) {
+    if (mapped)
+      munmap(image, imageSize);
+    else
+      free(image);
+  }
+  image = NULL; imageSize = 0; mapped = false;
+  header = NULL; slots = NULL; rows = NULL; packedRows = NULL;
+  numSlots = 0; numRows = 0; width = 0; rowEncoding = FLOAT_ROWS;
+}
+
+// Lay out an image for rowCount rows, keeping the index at most half full:
+void WeightTable::allocate(int rowWidth, uint64_t rowCount, uint64_t rowBytes) {
+  release();
+  uint64_t slotCount = 0;
+  if (rowCount > 0) {
+    slotCount = 1;
+    while (slotCount < 2 * rowCount) slotCount *= 2;
+  }
+  uint64_t slotsOffset = lineAlign(sizeof(ModelHeader));
+  uint64_t rowsOffset = lineAlign(slotsOffset + slotCount * sizeof(ModelSlot));
+  imageSize = lineAlign(rowsOffset + rowBytes);
+
+  void *mem = NULL;
+  if (posix_memalign(&mem, 64, imageSize) != 0) {
+    std::cerr << "Error! Could not allocate " << imageSize << " bytes of weights" << std::endl;
+    exit(-1);
+  }
+  image = (char *)mem;
+  memset(image, 0, imageSize);
+
+  ModelHeader *h = (ModelHeader *)image;
+  memcpy(h->magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+  h->version = MODEL_VERSION;
+  h->width = rowWidth;
+  h->numRows = rowCount;
+  h->numSlots = slotCount;
+  h->slotsOffset = slotsOffset;
+  h->rowsOffset = rowsOffset;
+  h->imageSize = imageSize;
+  h->encoding = FLOAT_ROWS;
+  TemplateMask all;
+  h->templates[0] = all.bits[0];
+  h->templates[1] = all.bits[1];
+
+  ModelSlot *s = (ModelSlot *)(image + slotsOffset);
+  for (uint64_t i=0; i<slotCount; i++)
+    s[i].row = EMPTY_ROW;
+
+  header = h;
+  slots = s;
+  rows = (const float *)(image + rowsOffset);
+  packedRows = (const uint8_t *)(image + rowsOffset);
+  numSlots = slotCount;
+  numRows = rowCount;
+  width = rowWidth;
+}
+
+// Add one row to an image being built:
+void WeightTable::insert(FeatureId key, const float *row, uint64_t rowIndex) {
+  insertSlot(key, rowIndex);
+  memcpy((float *)rows + rowIndex * width, row, width * sizeof(float));
+}
+
+void WeightTable::insertSlot(FeatureId key, uint32_t row) {
+  ModelSlot *s = (ModelSlot *)slots;
+  uint64_t mask = numSlots - 1;
+  uint64_t i = slotFor(key) & mask;
+  while (s[i].row != EMPTY_ROW)
+    i = (i + 1) & mask;
+  s[i].key = key;
+  s[i].row = row;
+}
+
+uint16_t floatToHalf(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  int exp = (int)((bits >> 23) & 0xFF) - 127 + 15;
+  uint32_t mant = bits & 0x7FFFFF;
+  if (((bits >> 23) & 0xFF) == 0xFF)
+    return sign | 0x7C00 | (mant ? 0x200 : 0);
+  if (exp >= 31)
+    return sign | 0x7C00;
+  if (exp <= 0) {
+    // Subnormal, or too small for even that:
+    if (exp < -10) return sign;
+    mant |= 0x800000;
+    int shift = 14 - exp;
+    uint32_t half = mant >> shift;
+    uint32_t rest = mant & ((1u << shift) - 1);
+    uint32_t midway = 1u << (shift - 1);
+    if (rest > midway || (rest == midway && (half & 1))) half++;
+    return sign | half;
+  }
+  // Rounding up can carry into the exponent, which is still right:
+  uint32_t half = sign | (exp << 10) | (mant >> 13);
+  uint32_t rest = mant & 0x1FFF;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+  return half;
+}
+
+// Compile text-loaded weights into an in-memory image:
+void WeightTable::build(const LinearWeightsMap &weights) {
+  allocate(LINEAR_MODEL, weights.size(), weights.size() * LINEAR_MODEL * sizeof(float));
+  uint64_t r = 0;
+  for (LinearWeightsMap::const_iterator itr = weights.begin(); itr != weights.end(); ++itr)
+    insert(itr->first, &(itr->second[0]), r++);
+}
+
+void WeightTable::build(const QuadWeightMap &weights) {
+  allocate(QUAD_MODEL, weights.size(), weights.size() * QUAD_MODEL * sizeof(float));
+  std::tr1::unordered_map<FeatureId,std::string> featNames;
+  uint64_t r = 0;
+  for (QuadWeightMap::const_iterator itr = weights.begin(); itr != weights.end(); ++itr) {
+    FeatureId id = featureId(itr->first);
+    if (!featNames.insert(std::make_pair(id, itr->first)).second) {
+      std::cerr << "Error! Features " << featNames[id] << " and " << itr->first << " have the same ID" << std::endl;
+      exit(-1);
+    }
+    insert(id, &(itr->second), r++);
+  }
+}
+
+void WeightTable::build(const UltraPairWeightsMap &weights) {
+  allocate(PAIR_MODEL, weights.size(), weights.size() * PAIR_MODEL * sizeof(float));
+  std::tr1::unordered_map<FeatureId,std::string> featNames;
+  uint64_t r = 0;
+  for (UltraPairWeightsMap::const_iterator itr = weights.begin(); itr != weights.end(); ++itr) {
+    FeatureId id = featureId(itr->first);
+    if (!featNames.insert(std::make_pair(id, itr->first)).second) {
+      std::cerr << "Error! Features " << featNames[id] << " and " << itr->first << " have the same ID" << std::endl;
+      exit(-1);
+    }
+    insert(id, &(itr->second[0]), r++);
+  }
+}
+
+// Pack float linear weights, scaling each lane so its largest weight
+// is 127 for int8:
+void WeightTable::pack(const WeightTable &from, RowEncoding packAs) {
+  if (from.width != LINEAR_MODEL || from.rowEncoding != FLOAT_ROWS || packAs == FLOAT_ROWS) {
+    std::cerr << "Error! Only float linear weights can be packed" << std::endl;
+    exit(-1);
+  }
+  float scales[LINEAR_MODEL];
+  for (int k=0; k<LINEAR_MODEL; k++)
+    scales[k] = 0;
+  for (uint64_t s=0; s<from.numSlots; s++) {
+    if (from.slots[s].row == EMPTY_ROW) continue;
+    const float *row = from.rows + (uint64_t)(from.slots[s].row) * LINEAR_MODEL;
+    for (int k=0; k<LINEAR_MODEL; k++)
+      if (fabs(row[k]) > scales[k]) scales[k] = fabs(row[k]);
+  }
+  for (int k=0; k<LINEAR_MODEL; k++)
+    scales[k] = (scales[k] > 0) ? scales[k] / 127 : 1;
+
+  // Pack the rows one after another, noting where each starts:
+  std::vector<uint8_t> packed;
+  std::vector<std::pair<FeatureId,uint32_t> > offsets;
+  double maxError[LINEAR_MODEL] = { 0 };
+  uint64_t nonzero = 0, dropped = 0;
+  for (uint64_t s=0; s<from.numSlots; s++) {
+    if (from.slots[s].row == EMPTY_ROW) continue;
+    const float *row = from.rows + (uint64_t)(from.slots[s].row) * LINEAR_MODEL;
+    uint64_t start = packed.size();
+    packed.push_back(0);
+    uint8_t lanes = 0;
+    for (int k=0; k<LINEAR_MODEL; k++) {
+      if (row[k] == 0) continue;
+      nonzero++;
+      float kept = 0;
+      if (packAs == INT8_ROWS) {
+	long q = lrintf(row[k] / scales[k]);
+	if (q > 127) q = 127;
+	if (q < -127) q = -127;
+	if (q != 0) {
+	  packed.push_back((uint8_t)(int8_t)q);
+	  kept = q * scales[k];
+	}
+      } else {
+	uint16_t h = floatToHalf(row[k]);
+	if ((h & 0x7FFF) != 0) {
+	  packed.push_back(h & 0xFF);
+	  packed.push_back(h >> 8);
+	  kept = halfToFloat(h);
+	}
+      }
+      if (kept != 0) lanes |= 1 << k;
+      else dropped++;
+      if (fabs(row[k] - kept) > maxError[k]) maxError[k] = fabs(row[k] - kept);
+    }
+    packed[start] = lanes;
+    if (start >= EMPTY_ROW) {
+      std::cerr << "Error! Too many weights to pack" << std::endl;
+      exit(-1);
+    }
+    offsets.push_back(std::make_pair(from.slots[s].key, (uint32_t)start));
+  }
+
+  // With room after the last row for a whole one, so a row can be read
+  // without knowing its length:
+  allocate(LINEAR_MODEL, offsets.size(), packed.size() + 2 * LINEAR_MODEL);
+  ModelHeader *h = (ModelHeader *)image;
+  h->encoding = packAs;
+  for (int k=0; k<LINEAR_MODEL; k++)
+    h->scales[k] = (packAs == INT8_ROWS) ? scales[k] : 1;
+  rowEncoding = packAs;
+  setTemplates(from.templates());
+  if (!packed.empty())
+    memcpy((uint8_t *)packedRows, &packed[0], packed.size());
+  for (size_t i=0; i<offsets.size(); i++)
+    insertSlot(offsets[i].first, offsets[i].second);
+
+  std::cerr << "Packed " << offsets.size() << " rows as " << ((packAs == INT8_ROWS) ? "int8" : "fp16")
+	    << ": " << imageSize << " bytes, from " << from.imageSize << std::endl;
+  std::cerr << dropped << " of " << nonzero << " nonzero weights rounded to zero; largest error per filter:";
+  for (int k=0; k<LINEAR_MODEL; k++)
+    std::cerr << " " << maxError[k];
+  std::cerr << std::endl;
+}
+
+TemplateMask WeightTable::templates() const {
+  TemplateMask mask;
+  if (header != NULL) {
+	mask.bits[0] = header->templates[0];
+	mask.bits[1] = header->templates[1];
+  }
+  return mask;
+}
+
+// For an image being built:
+void WeightTable::setTemplates(const TemplateMask &mask) {
+  ModelHeader *h = (ModelHeader *)image;
+  h->templates[0] = mask.bits[0];
+  h->templates[1] = mask.bits[1];
+}
+
+// Write the image out, for loading with mmap later:
+void WeightTable::save(const char *filename) const {
+  std::ofstream file(filename, std::ios::binary);
+  if (!file) {
+    std::cerr << "Error! Model file " << filename << " can not be opened" << std::endl;
+    exit(-1);
+  }
+  if (image != NULL) {
+    file.write(image, imageSize);
+  } else {
+    // Nothing loaded: still write a valid, empty image
+    WeightTable empty;
+    empty.allocate(width, 0, 0);
+    file.write(empty.image, empty.imageSize);
+  }
+  if (!file) {
+    std::cerr << "Error! Could not write model file " << filename << std::endl;
+    exit(-1);
+  }
+}
+
+// Map a compiled image, checking it's one we can read:
+void WeightTable::attach(const char *filename) {
+  release();
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    std::cerr << "Error! Model file " << filename << " can not be opened" << std::endl;
+    exit(-1);
+  }
+  void *mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    std::cerr << "Error! Model file " << filename << " can not be mapped" << std::endl;
+    exit(-1);
+  }
+  image = (char *)mem;
+  imageSize = st.st_size;
+  mapped = true;
+
+  const ModelHeader *h = (const ModelHeader *)image;
+  if (imageSize < sizeof(ModelHeader) || h->version != MODEL_VERSION) {
+    std::cerr << "Error! Model file " << filename << " has an unsupported version; recompile it" << std::endl;
+    exit(-1);
+  }
+  bool packed = (h->encoding != FLOAT_ROWS);
+  if (h->imageSize != imageSize ||
+      h->slotsOffset + h->numSlots * sizeof(ModelSlot) > imageSize ||
+      (!packed && h->rowsOffset + h->numRows * h->width * sizeof(float) > imageSize) ||
+      (packed && (h->width != LINEAR_MODEL || h->encoding > FP16_ROWS || h->rowsOffset > imageSize)) ||
+      (h->numSlots & (h->numSlots - 1)) != 0 ||
+      h->slotsOffset % 64 != 0 || h->rowsOffset % 64 != 0) {
+    std::cerr << "Error! Model file " << filename << " is corrupt" << std::endl;
+    exit(-1);
+  }
+  header = h;
+  slots = (const ModelSlot *)(image + h->slotsOffset);
+  rows = (const float *)(image + h->rowsOffset);
+  packedRows = (const uint8_t *)(image + h->rowsOffset);
+  numSlots = h->numSlots;
+  numRows = h->numRows;
+  width = h->width;
+  rowEncoding = (RowEncoding)h->encoding;
+
+  // Packed rows are read without knowing their length, so the longest
+  // one (a full fp16 row) must fit after any offset:
+  if (packed) {
+    uint64_t rowsSize = imageSize - h->rowsOffset;
+    for (uint64_t s=0; s<numSlots; s++) {
+      if (slots[s].row == EMPTY_ROW) continue;
+      if (slots[s].row + 1 + 2 * LINEAR_MODEL > rowsSize) {
+	std::cerr << "Error! Model file " << filename << " is corrupt" << std::endl;
+	exit(-1);
+      }
+    }
+  }
+}
+
+// Compiled images start with the magic string:
+bool WeightTable::isImage(const char *filename) {
+  if (filename[0] == '0') return false;
+  char magic[sizeof(MODEL_MAGIC)];
+  std::ifstream file(filename, std::ios::binary);
+  return file.read(magic, sizeof(magic)) && memcmp(magic, MODEL_MAGIC, sizeof(magic)) == 0;
+}
+
+// Load either a compiled image or the original text weights:
+void WeightTable::load(const char *filename, ModelKind kind) {
+  if (isImage(filename)) {
+    std::cerr << "Mapping compiled weights ";
+    attach(filename);
+    if (width != kind) {
+      std::cerr << "Error! Model file " << filename << " holds the wrong kind of weights" << std::endl;
+      exit(-1);
+    }
+    std::cerr << "> done" << std::endl;
+    return;
+  }
+
+  // Otherwise parse the text and compile it here:
+  if (kind == LINEAR_MODEL) {
+    LinearWeightsMap weights;
+    initializeLinearWeights(filename, weights);
+    build(weights);
+  } else if (kind == QUAD_MODEL) {
+    QuadWeightMap weights;
+    initializeQuadWeights(filename, weights);
+    build(weights);
+  } else {
+    UltraPairWeightsMap weights;
+    initializeUltraPairWeights(filename, weights);
+    build(weights);
+  }
+}
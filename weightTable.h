@@ -0,0 +1,189 @@
+/******************************************
+ *
+ * weightTable.h
+ *
+ * A read-only table from feature IDs to rows of weights, laid out as
+ * one flat image: a header, an open-addressing hash index and the
+ * weight rows themselves.  compileModel writes this image to disk, and
+ * the filters can then mmap it rather than parse the text weights, so
+ * that startup is immediate and every process shares the same pages.
+ *
+ * The slots hold the 64-bit keys inline, four to a cache line, and the
+ * rows start on a cache line and are packed back to back, so that each
+ * 8-float linear row sits 32-byte aligned within a single line.  A hit
+ * touches the slot's line and the row's line, and nothing else.
+ *
+ * Linear weights can also be packed into compact rows: a byte with a
+ * bit for each of the eight lanes that's nonzero, then just those
+ * lanes, as int8s (times a per-lane scale) or as fp16s.  Most rows of
+ * an L1-trained model have only a few nonzero lanes, so these take a
+ * fraction of the space, at some cost in precision; compileModel
+ * reports how many decisions that changes.
+ *
+ ******************************************/
+
+#ifndef WEIGHTTABLE_H
+#define WEIGHTTABLE_H
+
+#include <stdint.h>   // For the fixed-size fields of the image
+#include <string.h>   // For memcpy
+
+#include "filterCommon.h"
+#include "featureTemplates.h"
+
+// Bump this whenever the image layout changes:
+const uint32_t MODEL_VERSION = 3;
+
+// The kinds of weights, which also give the number of floats per row:
+enum ModelKind { LINEAR_MODEL = 8, QUAD_MODEL = 1, PAIR_MODEL = 2 };
+
+// How the rows are stored.  Float rows are found by index; the packed
+// ones (linear weights only) by their byte offset from the first row:
+enum RowEncoding {
+  FLOAT_ROWS = 0,  // width floats
+  INT8_ROWS = 1,   // The lane mask, then an int8 per nonzero lane
+  FP16_ROWS = 2    // The lane mask, then an fp16 per nonzero lane
+};
+
+// The start of every image:
+struct ModelHeader {
+  char magic[8];         // "ARCFMODL"
+  uint32_t version;      // MODEL_VERSION
+  uint32_t width;        // Floats per row, i.e. the ModelKind
+  uint64_t numRows;
+  uint64_t numSlots;     // Always zero or a power of two
+  uint64_t slotsOffset;  // Byte offsets from the start of the image:
+  uint64_t rowsOffset;
+  uint64_t imageSize;
+  uint32_t encoding;     // RowEncoding
+  uint32_t unused;
+  float scales[8];       // For INT8_ROWS: what each lane's int8s are in units of
+  uint64_t templates[2]; // The TemplateMask of the features with weights
+};
+
+// One slot of the hash index:
+struct ModelSlot {
+  uint64_t key;          // The feature ID
+  uint32_t row;          // Index (or offset) of its row, or EMPTY_ROW
+  uint32_t unused;
+};
+
+const uint32_t EMPTY_ROW = 0xFFFFFFFF;
+
+// The fp16 conversions, rounding to nearest even:
+uint16_t floatToHalf(float f);
+inline float halfToFloat(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1F;
+  uint32_t mant = h & 0x3FF;
+  if (exp == 0) {
+	// Zero, or subnormal:
+	float f = mant * (1.0f / 16777216);
+	return sign ? -f : f;
+  }
+  uint32_t bits;
+  if (exp == 31)
+	bits = sign | 0x7F800000 | (mant << 13);
+  else
+	bits = sign | ((exp + 112) << 23) | (mant << 13);
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+class WeightTable {
+ public:
+  WeightTable();
+  ~WeightTable();
+
+  // Load either a compiled image (which gets mmapped) or the original
+  // text weights (which get compiled in memory).  A filename of "0"
+  // means a blank weight file, so nothing is loaded.
+  void load(const char *filename, ModelKind kind);
+
+  // Is this file a compiled image?
+  static bool isImage(const char *filename);
+
+  // Free (or unmap) the image, leaving an empty table:
+  void release();
+
+  // Compile text-loaded weights into an in-memory image:
+  void build(const LinearWeightsMap &weights);
+  void build(const QuadWeightMap &weights);
+  void build(const UltraPairWeightsMap &weights);
+
+  // Pack a table of float linear weights into the given encoding,
+  // reporting the rounding errors on std::cerr:
+  void pack(const WeightTable &from, RowEncoding packAs);
+
+  // Write the image out, for loading with mmap later:
+  void save(const char *filename) const;
+
+  // The row of weights for this feature, or NULL if it has none.  For
+  // float rows only:
+  inline const float *find(FeatureId key) const {
+    uint32_t row = findRow(key);
+    return (row != EMPTY_ROW) ? rows + (uint64_t)row * width : NULL;
+  }
+
+  // The packed row for this feature, or NULL if it has none.  For
+  // packed rows only:
+  inline const uint8_t *findPacked(FeatureId key) const {
+    uint32_t row = findRow(key);
+    return (row != EMPTY_ROW) ? packedRows + row : NULL;
+  }
+
+  // The slot's row field for this feature, or EMPTY_ROW:
+  inline uint32_t findRow(FeatureId key) const {
+    if (numSlots == 0) return EMPTY_ROW;
+    uint64_t mask = numSlots - 1;
+    for (uint64_t s = slotFor(key) & mask; ; s = (s + 1) & mask) {
+      if (slots[s].row == EMPTY_ROW) return EMPTY_ROW;
+      if (slots[s].key == key) return slots[s].row;
+    }
+  }
+
+  RowEncoding encoding() const { return rowEncoding; }
+  TemplateMask templates() const;
+  void setTemplates(const TemplateMask &mask);
+  const float *laneScales() const { return header->scales; }
+  int rowWidth() const { return width; }
+  uint64_t size() const { return numRows; }
+  bool isMapped() const { return mapped; }
+
+  // Where a key's probe sequence starts (before masking); part of the
+  // image format, so it must never change without a version bump:
+  static inline uint64_t slotFor(FeatureId key) {
+    uint64_t k = key;
+    return k ^ (k >> 32);
+  }
+
+ private:
+  // Lay out an image for numRows rows, taking rowBytes bytes in all,
+  // and point into it:
+  void allocate(int rowWidth, uint64_t rowCount, uint64_t rowBytes);
+  void insert(FeatureId key, const float *row, uint64_t rowIndex);
+  // Index a row that's already in place:
+  void insertSlot(FeatureId key, uint32_t row);
+  // Point the header, slots and rows into an image, checking it:
+  void attach(const char *filename);
+
+  // Not copyable: the image is owned (or mapped) by one table
+  WeightTable(const WeightTable &);
+  WeightTable &operator=(const WeightTable &);
+
+  char *image;
+  uint64_t imageSize;
+  bool mapped;
+
+  const ModelHeader *header;
+  const ModelSlot *slots;
+  const float *rows;
+  const uint8_t *packedRows;  // The same place, for packed rows
+  uint64_t numSlots;
+  uint64_t numRows;
+  int width;
+  RowEncoding rowEncoding;
+};
+
+#endif // WEIGHTTABLE_H